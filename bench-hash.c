@@ -0,0 +1,273 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "sha1sum.c"
+#include "sha256.c"
+#include "hash.c"
+
+/* SKL's own string routines, renamed to stay clear of the host libc's. */
+#define memcpy skl_memcpy
+#define memset skl_memset
+#define strlen skl_strlen
+#include "string.c"
+#undef strlen
+#undef memset
+#undef memcpy
+
+/*
+ * Throughput of the hashing and string primitives, built with the same flags
+ * as SKL itself, over the sizes SKL really deals with: a tag, an MBI, a
+ * kernel and an initrd.  Compare builds with e.g.
+ *
+ *   make bench-baseline; make bench LTO=y
+ *
+ * Output is one line per primitive and size, and doubles as the baseline
+ * format.  Cycles are TSC ticks, so only comparable on the same machine.
+ *
+ * Floating point is off limits (-mno-sse), so rates are in fixed point.
+ */
+#define MiB (1024 * 1024)
+
+static const u32 sizes[] = { 64, 16 * 1024, 10 * MiB, 200 * MiB };
+
+/* Consider each size for about this many bytes, but at least 3 times. */
+#define BENCH_BYTES (256 * MiB)
+
+/* Flag anything this many percent slower than the baseline */
+#define DEFAULT_THRESHOLD 10
+
+static u8 *src, *dst;
+
+static void do_sha1(u32 len)
+{
+    u8 hash[SHA1_DIGEST_SIZE];
+
+    sha1sum(hash, src, len);
+}
+
+static void do_sha256(u32 len)
+{
+    u8 hash[SHA256_DIGEST_SIZE];
+
+    sha256sum(hash, src, len);
+}
+
+static void do_sha1sha256(u32 len)
+{
+    u8 sha1[SHA1_DIGEST_SIZE], sha256[SHA256_DIGEST_SIZE];
+
+    sha1sha256sum(sha1, sha256, src, len);
+}
+
+#ifdef ENABLE_SIMD
+/*
+ * The choice extend_batch() makes for a TPM with SHA-1 and SHA-256 banks on
+ * a CPU without SHA-NI: the fused pass over each region, or SHA-256 in the
+ * lanes plus a SHA-1 walk over each.  A batch of SHA256_MB_LANES regions
+ * makes up len.
+ */
+static void do_sha1sha256_sw(u32 len)
+{
+    u8 sha1[SHA1_DIGEST_SIZE], sha256[SHA256_DIGEST_SIZE];
+    u32 each = len / SHA256_MB_LANES;
+
+    sha_ni_disabled = true;
+    for ( unsigned int i = 0; i < SHA256_MB_LANES; ++i )
+        sha1sha256sum(sha1, sha256, src + i * each, each);
+    sha_ni_disabled = false;
+}
+
+static void do_sha256mb_sha1(u32 len)
+{
+    u8 sha1[SHA1_DIGEST_SIZE], sha256[SHA256_MB_LANES][SHA256_DIGEST_SIZE];
+    const void *data[SHA256_MB_LANES];
+    u32 each = len / SHA256_MB_LANES, lens[SHA256_MB_LANES];
+
+    sha_ni_disabled = true;
+    for ( unsigned int i = 0; i < SHA256_MB_LANES; ++i )
+    {
+        data[i] = src + i * each;
+        lens[i] = each;
+    }
+    sha256sum_mb(sha256, data, lens, SHA256_MB_LANES);
+    for ( unsigned int i = 0; i < SHA256_MB_LANES; ++i )
+        sha1sum(sha1, data[i], each);
+    sha_ni_disabled = false;
+}
+#endif
+
+static void do_memcpy(u32 len)
+{
+    skl_memcpy(dst, src, len);
+}
+
+static void do_memset(u32 len)
+{
+    skl_memset(dst, 0xcc, len);
+}
+
+static const struct bench {
+    const char *name;
+    void (*fn)(u32 len);
+} benches[] = {
+    { "sha1",       do_sha1 },
+    { "sha256",     do_sha256 },
+    { "sha1sha256", do_sha1sha256 },
+#ifdef ENABLE_SIMD
+    { "sha1sha256-sw", do_sha1sha256_sw },
+    { "sha256mb+sha1", do_sha256mb_sha1 },
+#endif
+    { "memcpy",     do_memcpy },
+    { "memset",     do_memset },
+};
+
+static u64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct result {
+    u64 cpb100;     /* cycles/byte, x100 */
+    u64 mbps;       /* MB/s, MB being 10^6 bytes */
+};
+
+/* Best of several runs, as the slower ones are just noise. */
+static struct result measure(const struct bench *b, u32 len)
+{
+    u64 runs = BENCH_BYTES / len, best_cyc = ~0ULL, best_ns = ~0ULL;
+    u64 inner = 1;
+
+    /* Batch small sizes so each run is long enough to time. */
+    if ( runs > 1000 )
+    {
+        inner = runs / 1000;
+        runs = 1000;
+    }
+    if ( runs < 3 )
+        runs = 3;
+
+    for ( u64 r = 0; r < runs; ++r )
+    {
+        u64 ns = now_ns(), cyc = __builtin_ia32_rdtsc();
+
+        for ( u64 i = 0; i < inner; ++i )
+            b->fn(len);
+
+        cyc = __builtin_ia32_rdtsc() - cyc;
+        ns = now_ns() - ns;
+
+        if ( cyc < best_cyc )
+            best_cyc = cyc;
+        if ( ns < best_ns )
+            best_ns = ns;
+    }
+
+    return (struct result){
+        .cpb100 = best_cyc * 100 / (inner * len),
+        .mbps = best_ns ? inner * len * 1000 / best_ns : 0,
+    };
+}
+
+/* Look up name/len in the baseline, returning cycles/byte x100 or 0. */
+static u64 baseline(FILE *f, const char *name, u32 len)
+{
+    char line[128], n[32];
+    u64 cpb100, mbps;
+    u32 l;
+
+    if ( !f )
+        return 0;
+
+    rewind(f);
+    while ( fgets(line, sizeof(line), f) )
+    {
+        unsigned int whole, frac;
+
+        if ( sscanf(line, "%31s %"SCNu32" %u.%u %"SCNu64,
+                    n, &l, &whole, &frac, &mbps) != 5 )
+            continue;
+
+        cpb100 = whole * 100ULL + frac;
+        if ( l == len && !strcmp(n, name) )
+            return cpb100;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *base = NULL;
+    unsigned int threshold = DEFAULT_THRESHOLD;
+    bool regressed = false;
+
+    if ( argc > 1 && !(base = fopen(argv[1], "r")) )
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    if ( argc > 2 )
+        threshold = atoi(argv[2]);
+
+    src = malloc(sizes[ARRAY_SIZE(sizes) - 1]);
+    dst = malloc(sizes[ARRAY_SIZE(sizes) - 1]);
+    if ( !src || !dst )
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    /* Also faults everything in, so the first run isn't penalised. */
+    for ( u32 i = 0; i < sizes[ARRAY_SIZE(sizes) - 1]; ++i )
+    {
+        src[i] = i * 7 + 3;
+        dst[i] = 0;
+    }
+
+    printf("# %-12s %10s %8s %8s\n", "primitive", "bytes", "cyc/B", "MB/s");
+
+    for ( unsigned int i = 0; i < ARRAY_SIZE(benches); ++i )
+    {
+        for ( unsigned int j = 0; j < ARRAY_SIZE(sizes); ++j )
+        {
+            const struct bench *b = &benches[i];
+            struct result r = measure(b, sizes[j]);
+            u64 old = baseline(base, b->name, sizes[j]);
+
+            printf("%-14s %10"PRIu32" %5"PRIu64".%02"PRIu64" %8"PRIu64,
+                   b->name, sizes[j], r.cpb100 / 100, r.cpb100 % 100, r.mbps);
+
+            if ( old )
+            {
+                /* Percentage change in cycles/byte, positive is slower */
+                int delta = (int)((s64)(r.cpb100 - old) * 100 / (s64)old);
+
+                printf("  %+4d%%", delta);
+                if ( delta > (int)threshold )
+                {
+                    printf("  REGRESSION");
+                    regressed = true;
+                }
+            }
+
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    if ( base )
+        fclose(base);
+
+    if ( regressed )
+        printf("# Slower than the baseline by more than %u%%\n", threshold);
+
+    return regressed;
+}
@@ -41,8 +41,6 @@ static int log_write(const void *data, unsigned size)
 #define EV_NO_ACTION    0x3
 #define EV_TYPE_SLAUNCH 0x502
 
-#define HASH_COUNT 2
-
 /* For compatibility with TXT and easier operations */
 
 #define TPM12_EVTLOG_SIGNATURE "TXT Event Container"
@@ -84,21 +82,14 @@ typedef struct __packed {
     tpm12_event_log_header hdr;             /* AKA u8 vendor_info[]; */
 } tpm12_spec_id_ev_t;
 
-typedef struct __packed {
-    u32  number_of_algorithms;
-    /* Hardcode table size so we can use sizeof */
-    struct {
-        u16  id;
-        u16  size;
-    } digest_sizes[HASH_COUNT];
-} tpm20_digest_sizes_t;
-
-typedef struct __packed {
-    common_spec_id_ev_t c;
-    tpm20_digest_sizes_t sizes;
-    u8   vendor_info_size;
-    txt_event_log_pointer2_1_element el;    /* AKA u8 vendor_info[]; */
-} tpm20_spec_id_ev_t;
+/*
+ * The TPM 2.0 Spec ID event is common_spec_id_ev_t, then:
+ *   u32 number_of_algorithms;
+ *   struct { u16 id; u16 size; } digest_sizes[number_of_algorithms];
+ *   u8  vendor_info_size;
+ *   txt_event_log_pointer2_1_element el;   AKA u8 vendor_info[];
+ * with one digest_sizes[] entry for each bank in log_banks.
+ */
 
 /* Event log entries */
 
@@ -110,13 +101,21 @@ typedef struct __packed {
     /* u8 event[]; */
 } tpm12_event_t;
 
+/*
+ * TCG_PCR_EVENT2 is pcr, event_type and a TPML_DIGEST_VALUES (little endian)
+ * of a u16 alg and its digest for each bank, then event_size and event[].
+ */
 typedef struct __packed {
     u32 pcr;
     u32 event_type;
-    ev_log_hash_t digests;      /* defined in boot.h */
-    u32 event_size;
-    /* u8 event[]; */
-} tpm20_event_t;
+    u32 count;
+    /* { u16 alg; u8 digest[]; } digests[count]; */
+} tpm20_event_head_t;
+
+/* The banks in the Spec ID event, and their digests' size in each event */
+static u32 log_banks, log_count;
+static u32 log_digests_size;
+static txt_event_log_pointer2_1_element *tpm20_el;
 
 static tpm12_spec_id_ev_t tpm12_id_struct = {
     .c.signature = "Spec ID Event00",
@@ -139,20 +138,12 @@ static tpm12_spec_id_ev_t tpm12_id_struct = {
     .hdr.next_event_offset = sizeof(tpm12_event_log_header)
 };
 
-static tpm20_spec_id_ev_t tpm20_id_struct = {
-    .c.signature = "Spec ID Event03",
-    .c.spec_ver_minor = 0,
-    .c.spec_ver_major = 2,
-    .c.errata = 0,
-    .c.uintn_size = 2,
-    .sizes.number_of_algorithms = HASH_COUNT,
-    .sizes.digest_sizes[0].id = TPM_ALG_SHA1,
-    .sizes.digest_sizes[0].size = 20,
-    .sizes.digest_sizes[1].id = TPM_ALG_SHA256,
-    .sizes.digest_sizes[1].size = 32,
-    .vendor_info_size = sizeof(txt_event_log_pointer2_1_element),
-    .el.first_record_offset = 0,
-    .el.next_record_offset = sizeof(tpm20_spec_id_ev_t) + sizeof(tpm12_event_t)
+static const common_spec_id_ev_t tpm20_id_common = {
+    .signature = "Spec ID Event03",
+    .spec_ver_minor = 0,
+    .spec_ver_major = 2,
+    .errata = 0,
+    .uintn_size = 2,
 };
 
 int log_event_tpm12(u32 pcr, u8 sha1[20], char *event)
@@ -176,34 +167,57 @@ int log_event_tpm12(u32 pcr, u8 sha1[20], char *event)
     return 1;
 }
 
-int log_event_tpm20(u32 pcr, u8 sha1[20], u8 sha256[32], char *event)
+/* Record size of a TPM 2.0 event, without event[] */
+static unsigned int tpm20_event_size(void)
 {
-    tpm20_event_t ev;
-    tpm20_spec_id_ev_t *base = (tpm20_spec_id_ev_t *)
-                                (evtlog_base + sizeof(tpm12_event_t));
+    return sizeof(tpm20_event_head_t) + log_digests_size + sizeof(u32);
+}
 
-    ev.event_size = strlen(event);
+/*
+ * Each bank in the Spec ID event gets its digest from digests[], in the same
+ * order as there, or zeroes if digests[] hasn't one.
+ */
+int log_event_tpm20(u32 pcr, struct tpm_pcr_digest *digests, u32 count,
+                    char *event)
+{
+    tpm20_event_head_t ev;
+    u32 event_size = strlen(event);
+    unsigned int size = tpm20_event_size() + event_size;
+    u32 i;
+    u16 alg;
 
-    if ( HAS_ENOUGH_SPACE(sizeof(ev) + ev.event_size) )
+    if ( !HAS_ENOUGH_SPACE(size) )
+        return 1;
+
+    ev.pcr = pcr;
+    ev.event_type = EV_TYPE_SLAUNCH;
+    ev.count = log_count;
+    log_write(&ev, sizeof(ev));
+
+    for ( alg = 0; alg < 32; alg++ )
     {
-        ev.pcr = pcr;
-        ev.event_type = EV_TYPE_SLAUNCH;
-        ev.digests.count = 2;
-        ev.digests.sha1_id = TPM_ALG_SHA1;
-        memcpy(ev.digests.sha1_hash, sha1, 20);
-        ev.digests.sha256_id = TPM_ALG_SHA256;
-        memcpy(ev.digests.sha256_hash, sha256, 32);
-        base->el.next_record_offset += sizeof(ev) + ev.event_size;
-        log_write(&ev, sizeof(ev));
-        return log_write(event, ev.event_size);
+        if ( !(log_banks & TPM_BANK(alg)) )
+            continue;
+
+        log_write(&alg, sizeof(alg));
+        for ( i = 0; i < count && digests[i].alg != alg; i++ )
+            ;
+        if ( i < count )
+            log_write(digests[i].digest, tpm_digest_size(alg));
+        else
+            ptr_current += tpm_digest_size(alg);    /* Zeroed by init */
     }
 
-    return 1;
+    log_write(&event_size, sizeof(event_size));
+    tpm20_el->next_record_offset += size;
+
+    return log_write(event, event_size);
 }
 
-int event_log_init(struct tpm *tpm)
+int event_log_init(struct tpm *tpm, u32 banks)
 {
-    unsigned int min_size;
+    unsigned int min_size, id_size;
+    u16 alg;
     struct skl_tag_evtlog *t = next_of_type(&bootloader_data, SKL_TAG_EVENT_LOG);
 
     if ( t == NULL || next_of_type(t, SKL_TAG_EVENT_LOG) != NULL )
@@ -211,22 +225,41 @@ int event_log_init(struct tpm *tpm)
 
     min_size = sizeof (tpm12_event_t);
 
-    if ( tpm->family == TPM12 )
+    if ( tpm_family(tpm) == TPM12 )
     {
-        min_size += sizeof(tpm12_id_struct);
+        id_size = sizeof(tpm12_id_struct);
+        min_size += id_size;
         min_size += 2 * sizeof(tpm12_event_t); /* SKL and kernel hashes */
     }
-    else if ( tpm->family == TPM20 )
+    else if ( tpm_family(tpm) == TPM20 )
     {
-        min_size += sizeof(tpm20_id_struct);
-        min_size += 2 * sizeof(tpm20_event_t); /* SKL and kernel hashes */
+        /*
+         * Log every bank SKL extends, and no others.  Any other bank the TPM
+         * has would only ever get zeroes in the log.
+         */
+        log_banks = log_count = log_digests_size = 0;
+        for ( alg = 0; alg < 32; alg++ )
+        {
+            if ( !(banks & TPM_BANK(alg)) || !tpm_digest_size(alg) )
+                continue;
+
+            log_banks |= TPM_BANK(alg);
+            log_count++;
+            log_digests_size += sizeof(u16) + tpm_digest_size(alg);
+        }
+
+        id_size = sizeof(tpm20_id_common) + sizeof(u32)
+                  + log_count * 2 * sizeof(u16) + sizeof(u8)
+                  + sizeof(txt_event_log_pointer2_1_element);
+        min_size += id_size;
+        min_size += 2 * tpm20_event_size(); /* SKL and kernel hashes */
     }
     else
     {
         goto err;
     }
 
-    /* Note that min_size does not include tpmXX_event_t.event[] entries */
+    /* Note that min_size does not include the events' event[] */
     if ( t->size < min_size )
         goto err;
 
@@ -245,13 +278,21 @@ int event_log_init(struct tpm *tpm)
     if ( !(_p(limit) < _p(_start) || _p(_start + SLB_SIZE) < _p(ptr_current)) )
         goto err;
 
-    tpm12_id_struct.hdr.container_size =
-            tpm20_id_struct.el.allocated_event_container_size =
-            t->size;
-    tpm20_id_struct.el.phys_addr = _u(evtlog_base);
+    tpm12_id_struct.hdr.container_size = t->size;
 
     memset(ptr_current, 0, t->size);
 
+#ifdef ENABLE_TPM_HASH
+    /*
+     * The end of the region receives TPM responses too big for the TIS
+     * buffer, and events are only logged before it.  The digests read from
+     * there are only logged, and the region is open to DMA anyway.
+     */
+    if ( tpm_family(tpm) == TPM20 && t->size >= min_size + TPM_SPILL_SIZE
+         && tpm_spill(tpm, limit - TPM_SPILL_SIZE, TPM_SPILL_SIZE) == 0 )
+        limit -= TPM_SPILL_SIZE;
+#endif
+
     /* Write log header */
     {
         tpm12_event_t ev;
@@ -259,21 +300,42 @@ int event_log_init(struct tpm *tpm)
         ev.pcr = 0;
         ev.event_type = EV_NO_ACTION;
         memset(ev.digest, 0, 20);
-        if ( tpm->family == TPM12 )
-            ev.event_size = sizeof(tpm12_id_struct);
-        else
-            ev.event_size = sizeof(tpm20_id_struct);
+        ev.event_size = id_size;
 
         log_write(&ev, sizeof(ev));
     }
 
-    if ( tpm->family == TPM12 )
+    if ( tpm_family(tpm) == TPM12 )
+    {
         log_write(&tpm12_id_struct, sizeof(tpm12_id_struct));
+    }
     else
-        log_write(&tpm20_id_struct, sizeof(tpm20_id_struct));
+    {
+        u8 vendor_info_size = sizeof(*tpm20_el);
+
+        log_write(&tpm20_id_common, sizeof(tpm20_id_common));
+        log_write(&log_count, sizeof(log_count));
+        for ( alg = 0; alg < 32; alg++ )
+        {
+            /* digest_sizes[] entry: the id, then the size */
+            u32 id = alg | (u32)tpm_digest_size(alg) << 16;
+
+            if ( log_banks & TPM_BANK(alg) )
+                log_write(&id, sizeof(id));
+        }
+        log_write(&vendor_info_size, sizeof(vendor_info_size));
+
+        /* Kept up to date by log_event_tpm20() */
+        tpm20_el = (txt_event_log_pointer2_1_element *)ptr_current;
+        tpm20_el->phys_addr = _u(evtlog_base);
+        tpm20_el->allocated_event_container_size = t->size;
+        tpm20_el->first_record_offset = 0;
+        ptr_current += sizeof(*tpm20_el);
+        tpm20_el->next_record_offset = ptr_current - evtlog_base;
+    }
 
     /* Log what was done by SKINIT */
-    if ( tpm->family == TPM12 )
+    if ( tpm_family(tpm) == TPM12 )
     {
         struct skl_tag_hash *h = next_of_type(&bootloader_data, SKL_TAG_SKL_HASH);
 
@@ -288,28 +350,30 @@ int event_log_init(struct tpm *tpm)
         /* No SHA1 hash was passed by a bootloader? */
         return 1;
     }
-     else
+    else
     {
         struct skl_tag_hash *h = next_of_type(&bootloader_data, SKL_TAG_SKL_HASH);
-        u8 *sha1 = NULL;
-        u8 *sha256 = NULL;
+        struct tpm_pcr_digest digests[5];
+        u32 found = 0, n = 0;
 
         while ( h != NULL )
         {
-            if ( h->algo_id == TPM_ALG_SHA1 )
-                sha1 = h->digest;
-
-            if ( h->algo_id == TPM_ALG_SHA256 )
-                sha256 = h->digest;
+            alg = h->algo_id;
 
-            if ( sha1 != NULL && sha256 != NULL )
-                return log_event_tpm20(17, sha1, sha256, "SKINIT");
+            if ( alg < 32 && (log_banks & ~found & TPM_BANK(alg)) )
+            {
+                digests[n++] = (struct tpm_pcr_digest){ alg, h->digest };
+                found |= TPM_BANK(alg);
+            }
 
             h = next_of_type(h, SKL_TAG_SKL_HASH);
         }
 
-        /* Either SHA1 or SHA256 hash wasn't passed by a bootloader? */
-        return 1;
+        /*
+         * Bootloaders may only pass SHA1 and SHA256 hashes; any other bank
+         * is logged as zeroes rather than losing the event.
+         */
+        return log_event_tpm20(17, digests, n, "SKINIT");
     }
 
 err:
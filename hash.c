@@ -0,0 +1,53 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <types.h>
+#include <hash.h>
+#include <string.h>
+
+/*
+ * The kernel and modules measured by SKL can be hundreds of megabytes, far
+ * more than fits in any cache.  Rather than streaming everything from memory
+ * once per algorithm, feed each chunk to both transforms while it is hot.
+ * Chunks are small enough to stay in L1, and large enough for the multi-block
+ * SHA-NI transforms to amortise loading and storing the state.
+ */
+#define STITCH_CHUNK    4096
+
+void sha1sha256sum(u8 sha1[static SHA1_DIGEST_SIZE],
+                   u8 sha256[static SHA256_DIGEST_SIZE],
+                   const void *ptr, u32 len)
+{
+    struct sha1_state sha1_ctx;
+    struct sha256_state sha256_ctx;
+
+    sha1_init(&sha1_ctx);
+    sha256_init(&sha256_ctx);
+
+    while ( len )
+    {
+        u32 chunk = len < STITCH_CHUNK ? len : STITCH_CHUNK;
+
+        sha1_update(&sha1_ctx, ptr, chunk);
+        sha256_update(&sha256_ctx, ptr, chunk);
+
+        ptr += chunk;
+        len -= chunk;
+    }
+
+    sha1_final(&sha1_ctx, sha1);
+    sha256_final(&sha256_ctx, sha256);
+}
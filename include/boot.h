@@ -57,15 +57,6 @@ typedef struct __packed skl_info {
 } skl_info_t;
 extern skl_info_t skl_info;
 
-/* The same as TPML_DIGEST_VALUES but little endian, as event log expects it */
-typedef struct __packed ev_log_hash {
-    u32 count;
-    u16 sha1_id;
-    u8 sha1_hash[20];
-    u16 sha256_id;
-    u8 sha256_hash[32];
-} ev_log_hash_t;
-
 /* Fences */
 #define mb()        asm volatile("mfence" : : : "memory")
 #define rmb()       asm volatile("lfence" : : : "memory")
@@ -130,6 +121,30 @@ static inline void iowrite32(u32 val, void *addr)
     barrier();
 }
 
+/*
+ * Without the fences, for a run of accesses to the same register.  Uncached
+ * MMIO is strongly ordered on x86 anyway, so only the compiler needs telling.
+ */
+static inline u8 ioread8_relaxed(void *addr)
+{
+    return *(volatile u8 *)addr;
+}
+
+static inline u32 ioread32_relaxed(void *addr)
+{
+    return *(volatile u32 *)addr;
+}
+
+static inline void iowrite8_relaxed(u8 val, void *addr)
+{
+    *(volatile u8 *)addr = val;
+}
+
+static inline void iowrite32_relaxed(u32 val, void *addr)
+{
+    *(volatile u32 *)addr = val;
+}
+
 /* Basic port I/O */
 static inline u8 inb(u16 port)
 {
@@ -177,6 +192,32 @@ static inline void io_delay(void)
     asm volatile("outb %%al,%0" : : "dN" (DELAY_PORT));
 }
 
+static inline u64 rdmsr(u32 msr)
+{
+    u32 lo, hi;
+
+    asm volatile("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+    return ((u64)hi << 32) | lo;
+}
+
+static inline void wrmsr(u32 msr, u64 val)
+{
+    asm volatile("wrmsr" : : "c" (msr), "a" ((u32)val), "d" ((u32)(val >> 32)));
+}
+
+static inline u64 rdtsc(void)
+{
+    u32 lo, hi;
+
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((u64)hi << 32) | lo;
+}
+
+static inline void cpu_relax(void)
+{
+    asm volatile("pause" ::: "memory");
+}
+
 static inline void stgi(void)
 {
     asm volatile(".byte 0x0f, 0x01, 0xdc" ::: "memory");
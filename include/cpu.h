@@ -0,0 +1,136 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __CPU_H__
+#define __CPU_H__
+
+#include <defs.h>
+#include <types.h>
+
+static inline void cpuid_count(u32 leaf, u32 subleaf,
+                               u32 *eax, u32 *ebx, u32 *ecx, u32 *edx)
+{
+    asm volatile ("cpuid"
+                  : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+                  : "0" (leaf), "2" (subleaf));
+}
+
+#if __STDC_HOSTED__
+
+/* Lets the unit tests exercise every code path on any host. */
+static bool __maybe_unused simd_disabled, sha_ni_disabled;
+
+/* The OS has already enabled SSE for us. */
+static inline bool simd_enabled(void)
+{
+    return !simd_disabled;
+}
+
+#else
+
+static inline unsigned long read_cr0(void)
+{
+    unsigned long cr0;
+
+    asm volatile ("mov %%cr0, %0" : "=r" (cr0));
+    return cr0;
+}
+
+static inline unsigned long read_cr4(void)
+{
+    unsigned long cr4;
+
+    asm volatile ("mov %%cr4, %0" : "=r" (cr4));
+    return cr4;
+}
+
+/*
+ * Vector instructions fault unless CR4.OSFXSR is set and CR0.TS/EM are
+ * clear.  head.S only sets things up that way when asked to, so check the
+ * live state rather than assuming.  Without SIMD=y nothing can use them, and
+ * the constant lets the compiler drop the vector code altogether.
+ */
+static inline bool simd_enabled(void)
+{
+#ifdef ENABLE_SIMD
+    return (read_cr4() & CR4_FXSR) && !(read_cr0() & (CR0_TS | CR0_EM));
+#else
+    return false;
+#endif
+}
+
+#endif /* __STDC_HOSTED__ */
+
+/*
+ * SHA1RNDS4/SHA256RNDS2 and friends, plus the SSSE3/SSE4.1 glue around them.
+ * CPUID is slow (and traps when virtualised), so only ask once; the hashing
+ * code calls this for every chunk.
+ */
+static inline bool cpu_has_sha(void)
+{
+    static s8 has_sha = -1;
+    u32 max, eax, ebx, ecx, edx;
+
+    if ( !simd_enabled() )
+        return false;
+
+#if __STDC_HOSTED__
+    if ( sha_ni_disabled )
+        return false;
+#endif
+
+    if ( has_sha >= 0 )
+        return has_sha;
+
+    has_sha = 0;
+
+    cpuid_count(0, 0, &max, &ebx, &ecx, &edx);
+    if ( max < 7 )
+        return false;
+
+    cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
+    if ( (ecx & (X86_FEATURE_SSSE3 | X86_FEATURE_SSE4_1)) !=
+         (X86_FEATURE_SSSE3 | X86_FEATURE_SSE4_1) )
+        return false;
+
+    cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+    has_sha = !!(ebx & X86_FEATURE_SHA);
+
+    return has_sha;
+}
+
+/*
+ * PSHUFB and PALIGNR, enough to vectorise the SHA-1/SHA-256 message schedule
+ * on CPUs without the SHA extensions.
+ */
+static inline bool cpu_has_ssse3(void)
+{
+    static s8 has_ssse3 = -1;
+    u32 eax, ebx, ecx, edx;
+
+    if ( !simd_enabled() )
+        return false;
+
+    if ( has_ssse3 < 0 )
+    {
+        cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
+        has_ssse3 = !!(ecx & X86_FEATURE_SSSE3);
+    }
+
+    return has_ssse3;
+}
+
+#endif /* __CPU_H__ */
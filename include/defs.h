@@ -100,6 +100,24 @@
 #define CR4_VMXE  0x00002000/* enable VMX */
 #define CR4_SMXE  0x00004000/* enable SMX */
 #define CR4_PCIDE 0x00020000/* enable PCID */
+#define CR4_OSXSAVE 0x00040000/* enable XSAVE and XCR0 */
+
+/* XCRs */
+#define XCR0_X87  0x00000001
+#define XCR0_SSE  0x00000002
+#define XCR0_AVX  0x00000004
+
+/* CPUID.1:ECX */
+#define X86_FEATURE_SSSE3       (1 <<  9)
+#define X86_FEATURE_SSE4_1      (1 << 19)
+#define X86_FEATURE_XSAVE       (1 << 26)
+#define X86_FEATURE_AVX         (1 << 28)
+
+/* CPUID.7.0:EBX */
+#define X86_FEATURE_SHA         (1 << 29)
+
+/* Power-on MXCSR: all exceptions masked */
+#define MXCSR_DEFAULT 0x1f80
 
 /* Pagetable bits */
 #define _PAGE_PRESENT  0x001
@@ -17,9 +17,11 @@
 #ifndef __EVENT_LOG_H__
 #define __EVENT_LOG_H__
 
-int event_log_init(struct tpm *tpm);
+/* banks are the PCR banks of a TPM2 SKL extends, and so the ones logged */
+int event_log_init(struct tpm *tpm, u32 banks);
 
 int log_event_tpm12(u32 pcr, u8 sha1[20], char *event);
-int log_event_tpm20(u32 pcr, u8 sha1[20], u8 sha256[32], char *event);
+int log_event_tpm20(u32 pcr, struct tpm_pcr_digest *digests, u32 count,
+                    char *event);
 
 #endif /* __EVENT_LOG_H__ */
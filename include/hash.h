@@ -0,0 +1,32 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <types.h>
+#include <sha1sum.h>
+#include <sha256.h>
+
+/*
+ * Calculate SHA-1 and SHA-256 of the same buffer in a single pass over
+ * memory.  Results are identical to sha1sum() and sha256sum().
+ */
+void sha1sha256sum(u8 sha1[static SHA1_DIGEST_SIZE],
+                   u8 sha256[static SHA256_DIGEST_SIZE],
+                   const void *ptr, u32 len);
+
+#endif /* __HASH_H__ */
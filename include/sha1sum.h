@@ -22,6 +22,25 @@
 
 #define SHA1_DIGEST_SIZE 20
 
+struct sha1_state {
+    u64 count;
+    union {
+        struct {
+            u32 h0, h1, h2, h3, h4;
+        };
+        u32 h[5];
+    };
+    unsigned char buf[64];
+};
+
+/*
+ * Incremental interface, for digests covering several non-contiguous regions
+ * or regions larger than 4G.  sha1sum() is init + update + final.
+ */
+void sha1_init(struct sha1_state *hd);
+void sha1_update(struct sha1_state *hd, const void *data, size_t len);
+void sha1_final(struct sha1_state *hd, u8 hash[SHA1_DIGEST_SIZE]);
+
 void sha1sum(u8 hash[static SHA1_DIGEST_SIZE], const void *ptr, u32 len);
 
 #endif /* __SHA1SUM_H__ */
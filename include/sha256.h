@@ -13,7 +13,30 @@
 #include <types.h>
 
 #define SHA256_DIGEST_SIZE	32
+#define SHA256_BLOCK_SIZE	64
+
+struct sha256_state {
+    u32 state[SHA256_DIGEST_SIZE / 4];
+    u64 count;
+    u8 buf[SHA256_BLOCK_SIZE];
+};
+
+/* Incremental interface, see sha1sum.h */
+void sha256_init(struct sha256_state *sctx);
+void sha256_update(struct sha256_state *sctx, const void *data, size_t len);
+void sha256_final(struct sha256_state *sctx, void *dst);
 
 void sha256sum(u8 hash[static SHA256_DIGEST_SIZE], const void *ptr, u32 len);
 
+/*
+ * Multi-buffer interface: hash[i] = sha256sum(data[i], len[i]) for each of
+ * the n buffers, up to SHA256_MB_LANES at a time.  Only faster when
+ * sha256_mb_available(), otherwise the buffers are simply hashed in turn.
+ */
+#define SHA256_MB_LANES		4
+
+bool sha256_mb_available(void);
+void sha256sum_mb(u8 (*hash)[SHA256_DIGEST_SIZE], const void *const *data,
+                  const u32 *len, unsigned int n);
+
 #endif /* SHA256_H */
@@ -0,0 +1,47 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SHA512_H
+#define SHA512_H
+
+#include <types.h>
+
+#define SHA384_DIGEST_SIZE	48
+#define SHA512_DIGEST_SIZE	64
+#define SHA512_BLOCK_SIZE	128
+
+/*
+ * SHA-384 is SHA-512 with different initial values and a truncated digest,
+ * so both share a context and sha512_update().  The length field in the
+ * padding is 128 bits wide, but a 64 bit byte count is plenty here.
+ */
+struct sha512_state {
+    u64 state[SHA512_DIGEST_SIZE / 8];
+    u64 count;
+    u8 buf[SHA512_BLOCK_SIZE];
+};
+
+/* Incremental interface, see sha1sum.h */
+void sha384_init(struct sha512_state *sctx);
+void sha512_init(struct sha512_state *sctx);
+void sha512_update(struct sha512_state *sctx, const void *data, size_t len);
+void sha384_final(struct sha512_state *sctx, void *dst);
+void sha512_final(struct sha512_state *sctx, void *dst);
+
+void sha384sum(u8 hash[static SHA384_DIGEST_SIZE], const void *ptr, u32 len);
+void sha512sum(u8 hash[static SHA512_DIGEST_SIZE], const void *ptr, u32 len);
+
+#endif /* SHA512_H */
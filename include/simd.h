@@ -0,0 +1,34 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+/*
+ * Vector intrinsics for the few routines which are allowed to use them.
+ * Everything is still built with -mno-sse, so users must mark functions with
+ * __attribute__((target(...))) and check cpu.h before calling them.
+ *
+ * xmmintrin.h pulls in mm_malloc.h, and with it stdlib.h, which doesn't
+ * exist for a freestanding build.  Pretend it has already been included.
+ */
+#if !__STDC_HOSTED__
+#define _MM_MALLOC_H_INCLUDED
+#endif
+
+#include <immintrin.h>
+
+#endif /* __SIMD_H__ */
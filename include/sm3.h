@@ -0,0 +1,38 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SM3_H
+#define SM3_H
+
+#include <types.h>
+
+#define SM3_DIGEST_SIZE		32
+#define SM3_BLOCK_SIZE		64
+
+struct sm3_state {
+    u32 state[SM3_DIGEST_SIZE / 4];
+    u64 count;
+    u8 buf[SM3_BLOCK_SIZE];
+};
+
+/* Incremental interface, see sha1sum.h */
+void sm3_init(struct sm3_state *sctx);
+void sm3_update(struct sm3_state *sctx, const void *data, size_t len);
+void sm3_final(struct sm3_state *sctx, void *dst);
+
+void sm3sum(u8 hash[static SM3_DIGEST_SIZE], const void *ptr, u32 len);
+
+#endif /* SM3_H */
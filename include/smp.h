@@ -0,0 +1,79 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __SMP_H__
+#define __SMP_H__
+
+#include <types.h>
+
+#define MSR_APIC_BASE           0x0000001b
+#define APIC_BASE_EXTD          (1 << 10)   /* x2APIC mode */
+#define APIC_BASE_EN            (1 << 11)
+#define APIC_BASE_ADDR_MASK     0xfffff000
+
+#define APIC_ICR_LO             0x300
+#define APIC_ICR_HI             0x310
+#define MSR_X2APIC_ICR          0x00000830
+
+#define APIC_DM_INIT            0x00000500
+#define APIC_DM_STARTUP         0x00000600
+#define APIC_ICR_BUSY           0x00001000
+#define APIC_INT_ASSERT         0x00004000
+#define APIC_DEST_ALLBUT        0x000c0000
+
+/* Small enough to keep the job lists in .bss, and plenty for SKL's work */
+#define SMP_MAX_APS             7
+
+/*
+ * Hash data into sha1 and/or sha256, whichever are not NULL.  With both, the
+ * single pass sha1sha256sum() is used.
+ */
+struct hash_job {
+    const void *data;
+    u32 size;
+    u8 *sha1;
+    u8 *sha256;
+};
+
+/*
+ * Run the n jobs on this CPU and the APs, returning once all are done.  Only
+ * exists with ENABLE_SMP, so guard calls with smp_active().
+ */
+void smp_hash(struct hash_job *jobs, unsigned int n);
+
+#ifdef ENABLE_SMP
+
+/*
+ * Start up to SMP_MAX_APS APs in the region given by the SKL_TAG_SMP tag, if
+ * there is one.  Must only be called once the IOMMU protects the region.
+ */
+void smp_start(void);
+
+/* Put the APs back into wait-for-SIPI, ready for the kernel to start them. */
+void smp_stop(void);
+
+/* Whether smp_start() started any APs, so smp_hash() is worth using. */
+bool smp_active(void);
+
+#else
+
+static inline void smp_start(void) {}
+static inline void smp_stop(void) {}
+static inline bool smp_active(void) { return false; }
+
+#endif /* ENABLE_SMP */
+
+#endif /* __SMP_H__ */
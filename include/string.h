@@ -3,7 +3,7 @@
 
 #if __STDC_HOSTED__
 
-#include <string.h>	/* memcpy, memset */
+#include_next <string.h>	/* memcpy, memset */
 
 #else
 
@@ -26,6 +26,8 @@ struct setup_data {
 #define SKL_TAG_NO_CLASS         0x00
 #define SKL_TAG_END              0x00
 #define SKL_TAG_SETUP_INDIRECT   0x01
+#define SKL_TAG_SMP              0x02
+#define SKL_TAG_TPM_TRACE        0x03
 #define SKL_TAG_TAGS_SIZE        0x0F    /* Always first */
 
 /* Tags specifying kernel type */
@@ -72,6 +74,27 @@ struct skl_tag_hash {
     u8 digest[];
 } __packed;
 
+/*
+ * Low memory SKL may use to start APs (SMP=y builds only).  address must be
+ * page aligned and below 1M.  The first page holds the real mode trampoline,
+ * and each following page the stack of one AP.
+ */
+struct skl_tag_smp {
+    struct skl_tag_hdr hdr;
+    u32 address;
+    u32 size;
+} __packed;
+
+/*
+ * Memory for a struct tpm_trace_ring (TPM_TRACE=y builds only), which SKL
+ * fills in for the OS to read back.  It must not overlap SKL.
+ */
+struct skl_tag_tpm_trace {
+    struct skl_tag_hdr hdr;
+    u32 address;
+    u32 size;
+} __packed;
+
 struct skl_tag_setup_indirect {
     struct skl_tag_hdr hdr;
     struct setup_data data;
@@ -79,6 +102,12 @@ struct skl_tag_setup_indirect {
 
 extern struct skl_tag_tags_size bootloader_data;
 
+/*
+ * Whether [address, address + size) overlaps the region of an event log, SMP
+ * or TPM trace tag, other than the tag except.  SKL writes to all of them.
+ */
+bool overlaps_skl_region(u64 address, u64 size, void *except);
+
 static inline void *end_of_tags(void)
 {
     return (((void *) &bootloader_data) + bootloader_data.size);
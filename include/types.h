@@ -27,6 +27,7 @@
  * If we are hosted (i.e. compiling the unit tests), use stdint.h to be
  * compatible with the rest of the environment.
  */
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef  uint8_t  u8;
@@ -55,10 +56,12 @@ typedef long long           s64;
 
 typedef unsigned long       uintptr_t;
 
-typedef unsigned long       size_t;
+typedef __SIZE_TYPE__       size_t;
 typedef long                ssize_t;
 
 typedef _Bool               bool;
+#define true                1
+#define false               0
 
 #define NULL ((void *)0)
 
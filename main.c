@@ -18,13 +18,19 @@
 
 #include <defs.h>
 #include <types.h>
+#include <errno-base.h>
 #include <boot.h>
 #include <pci.h>
 #include <iommu.h>
 #include "tpmlib/tpm.h"
 #include "tpmlib/tpm2_constants.h"
+#include "tpmlib/tpm_trace.h"
 #include <sha1sum.h>
 #include <sha256.h>
+#include <sha512.h>
+#include <sm3.h>
+#include <hash.h>
+#include <smp.h>
 #include <linux-bootparams.h>
 #include <event_log.h>
 #include <multiboot2.h>
@@ -45,31 +51,376 @@ skl_info_t __section(".skl_info") __used skl_info = {
     .msb_key_hash = { 0 },
 };
 
-static void extend_pcr(struct tpm *tpm, void *data, u32 size, u32 pcr, char *ev)
+/*
+ * Even though die() has both __attribute__((noreturn)) and unreachable(),
+ * Clang still complains if it isn't repeated here.
+ */
+static void __attribute__((noreturn)) reboot(void)
 {
-    u8 hash[SHA1_DIGEST_SIZE];
-    sha1sum(hash, data, size);
-    print("shasum calculated:\n");
-    hexdump(hash, SHA1_DIGEST_SIZE);
-    tpm_extend_pcr(tpm, pcr, TPM_ALG_SHA1, hash);
+    print("Rebooting now...");
+    die();
+    unreachable();
+}
 
-    if ( tpm->family == TPM12 )
+bool overlaps_skl_region(u64 address, u64 size, void *except)
+{
+    struct skl_tag_hdr *t = (void *)&bootloader_data;
+
+    while ( (t = next_tag(t)) != NULL && t->type != SKL_TAG_END )
     {
-        log_event_tpm12(pcr, hash, ev);
+        /* The event log, SMP and TPM trace tags share this layout */
+        struct skl_tag_evtlog *r = (void *)t;
+
+        if ( t == except
+             || (t->type != SKL_TAG_EVENT_LOG && t->type != SKL_TAG_SMP
+                 && t->type != SKL_TAG_TPM_TRACE) )
+            continue;
+
+        if ( address < (u64)r->address + r->size
+             && r->address < address + size )
+            return true;
     }
-    else if ( tpm->family == TPM20 )
+
+    return false;
+}
+
+/*
+ * SKL goes on writing to its regions after it has measured the kernel, MBI
+ * and modules, so none of them may overlap what it measures.
+ */
+static void check_measured(void *data, u32 size)
+{
+    if ( overlaps_skl_region(_u(data), size, NULL) )
     {
-        u8 sha256_hash[SHA256_DIGEST_SIZE];
+        print("Measured data overlaps a region SKL writes\n");
+        reboot();
+    }
+}
+
+/* The banks SKL can calculate digests for itself */
+static const u32 sw_banks = TPM_BANK(TPM_ALG_SHA1) | TPM_BANK(TPM_ALG_SHA256)
+#ifdef ENABLE_SHA384
+                            | TPM_BANK(TPM_ALG_SHA384)
+#endif
+#ifdef ENABLE_SHA512
+                            | TPM_BANK(TPM_ALG_SHA512)
+#endif
+#ifdef ENABLE_SM3
+                            | TPM_BANK(TPM_ALG_SM3_256)
+#endif
+                            ;
+
+/*
+ * The banks of a TPM2 which SKL extends, so the only ones the event log may
+ * list: those it has digests for, or with TPM_HASH all of them, as the TPM
+ * hashes into the others itself.
+ */
+static u32 extended_banks(struct tpm *tpm)
+{
+#ifdef ENABLE_TPM_HASH
+    return tpm_pcr_banks(tpm);
+#else
+    return tpm_pcr_banks(tpm) & sw_banks;
+#endif
+}
+
+#ifdef ENABLE_TPM_HASH
+/*
+ * Whether to leave the hashing to a TPM2: always if it has a bank SKL can't
+ * calculate, and otherwise if the data is small enough for a single
+ * TPM2_PCR_Event to be cheaper than hashing it here and extending.
+ */
+static bool tpm_hashes(struct tpm *tpm, u32 size)
+{
+    return tpm_family(tpm) == TPM20 && ((tpm_pcr_banks(tpm) & ~sw_banks)
+                                    || size <= tpm_event_max(tpm));
+}
 
-        sha256sum(sha256_hash, data, size);
+/*
+ * Have the TPM hash data into every bank, and log the digests it returns.
+ * Not inlined, and with static buffers as in extend_batch(), so that none of
+ * this is on the stack while __extend_pcr() hashes in software.
+ */
+static int noinline tpm_hash_extend(struct tpm *tpm, void *data, u32 size,
+                                    u32 pcr, char *ev)
+{
+    static const u16 algs[] = {
+        TPM_ALG_SHA1, TPM_ALG_SHA256, TPM_ALG_SHA384, TPM_ALG_SHA512,
+        TPM_ALG_SM3_256,
+    };
+    static u8 tpm_digests[ARRAY_SIZE(algs)][SHA512_DIGEST_SIZE];
+    static struct tpm_pcr_digest digests[ARRAY_SIZE(algs)];
+    unsigned int i;
+    int ret;
+
+    /*
+     * The TPM fills in the banks it has; the log only takes those, and a
+     * bank the response leaves out is logged as zeroes.
+     */
+    memset(tpm_digests, 0, sizeof(tpm_digests));
+    for ( i = 0; i < ARRAY_SIZE(algs); i++ )
+        digests[i] = (struct tpm_pcr_digest){ algs[i], tpm_digests[i] };
+
+    ret = tpm_pcr_event(tpm, pcr, data, size, digests, ARRAY_SIZE(algs));
+    if ( ret < 0 )
+        return ret;
+
+    log_event_tpm20(pcr, digests, ARRAY_SIZE(algs), ev);
+
+    return 0;
+}
+#else
+static bool tpm_hashes(struct tpm *tpm, u32 size)
+{
+    return false;
+}
+
+static int tpm_hash_extend(struct tpm *tpm, void *data, u32 size, u32 pcr,
+                           char *ev)
+{
+    return -EINVAL;
+}
+#endif /* ENABLE_TPM_HASH */
+
+/* Report any failure of the extends submitted since the last check */
+static void check_extends(struct tpm *tpm)
+{
+    if ( tpm_complete(tpm) < 0 )
+        print("An earlier PCR extend failed\n");
+}
+
+/*
+ * sha1_hash and sha256_hash may already hold the digests of the data (see
+ * extend_batch()), otherwise they are calculated here.  Only the banks the
+ * TPM has allocated are calculated and extended, unless tpm_hashes() leaves
+ * it all to the TPM.  The event log gets the same digests.
+ */
+static void __extend_pcr(struct tpm *tpm, void *data, u32 size, u32 pcr,
+                         char *ev, u8 *sha1_hash, u8 *sha256_hash)
+{
+    /* Static, as in extend_batch(), to keep them off the stage 1 stack */
+    static u8 hash[SHA1_DIGEST_SIZE];
+
+    if ( sha1_hash )
+        memcpy(hash, sha1_hash, SHA1_DIGEST_SIZE);
+
+    if ( tpm_family(tpm) == TPM12 )
+    {
+        if ( !sha1_hash )
+            sha1sum(hash, data, size);
         print("shasum calculated:\n");
-        hexdump(sha256_hash, SHA256_DIGEST_SIZE);
-        tpm_extend_pcr(tpm, pcr, TPM_ALG_SHA256, &sha256_hash[0]);
+        hexdump(hash, SHA1_DIGEST_SIZE);
+        if ( tpm_extend_pcr(tpm, pcr, TPM_ALG_SHA1, hash) < 0 )
+            goto fail;
 
-        log_event_tpm20(pcr, hash, sha256_hash, ev);
+        log_event_tpm12(pcr, hash, ev);
     }
+    else if ( tpm_family(tpm) == TPM20 )
+    {
+        /* Every active bank goes in a single TPM2_PCR_Extend, and the log */
+        static struct tpm_pcr_digest digests[5];
+        unsigned int nr_digests = 0;
+        u32 banks = tpm_pcr_banks(tpm);
+        bool do_sha1 = !sha1_hash && (banks & TPM_BANK(TPM_ALG_SHA1));
+        bool do_sha256 = !sha256_hash && (banks & TPM_BANK(TPM_ALG_SHA256));
+        static u8 sha256_buf[SHA256_DIGEST_SIZE];
+#ifdef ENABLE_SHA384
+        static u8 sha384_hash[SHA384_DIGEST_SIZE];
+#endif
+#ifdef ENABLE_SHA512
+        static u8 sha512_hash[SHA512_DIGEST_SIZE];
+#endif
+#ifdef ENABLE_SM3
+        static u8 sm3_hash[SM3_DIGEST_SIZE];
+#endif
+
+        /*
+         * Should the TPM fail to hash the data, hash here instead, but only
+         * if it can't have extended the PCR already (see tpm_pcr_event()).
+         */
+        if ( !sha1_hash && !sha256_hash && tpm_hashes(tpm, size) )
+        {
+            int ret = tpm_hash_extend(tpm, data, size, pcr, ev);
 
+            if ( ret == 0 )
+                goto out;
+            if ( ret == -EIO )
+                goto fail;
+        }
+
+        /* With both banks needed, only walk the data once. */
+        if ( do_sha1 && do_sha256 )
+            sha1sha256sum(hash, sha256_buf, data, size);
+        else if ( do_sha256 )
+            sha256sum(sha256_buf, data, size);
+        else if ( do_sha1 )
+            sha1sum(hash, data, size);
+        sha256_hash = sha256_hash ?: sha256_buf;
+
+        if ( banks & TPM_BANK(TPM_ALG_SHA1) )
+        {
+            print("shasum calculated:\n");
+            hexdump(hash, SHA1_DIGEST_SIZE);
+            digests[nr_digests++] = (struct tpm_pcr_digest){ TPM_ALG_SHA1,
+                                                             hash };
+        }
+        if ( banks & TPM_BANK(TPM_ALG_SHA256) )
+        {
+            print("shasum calculated:\n");
+            hexdump(sha256_hash, SHA256_DIGEST_SIZE);
+            digests[nr_digests++] = (struct tpm_pcr_digest){ TPM_ALG_SHA256,
+                                                             sha256_hash };
+        }
+#ifdef ENABLE_SHA384
+        if ( banks & TPM_BANK(TPM_ALG_SHA384) )
+        {
+            sha384sum(sha384_hash, data, size);
+            print("shasum calculated:\n");
+            hexdump(sha384_hash, SHA384_DIGEST_SIZE);
+            digests[nr_digests++] = (struct tpm_pcr_digest){ TPM_ALG_SHA384,
+                                                             sha384_hash };
+        }
+#endif
+#ifdef ENABLE_SHA512
+        if ( banks & TPM_BANK(TPM_ALG_SHA512) )
+        {
+            sha512sum(sha512_hash, data, size);
+            print("shasum calculated:\n");
+            hexdump(sha512_hash, SHA512_DIGEST_SIZE);
+            digests[nr_digests++] = (struct tpm_pcr_digest){ TPM_ALG_SHA512,
+                                                             sha512_hash };
+        }
+#endif
+#ifdef ENABLE_SM3
+        if ( banks & TPM_BANK(TPM_ALG_SM3_256) )
+        {
+            sm3sum(sm3_hash, data, size);
+            print("sm3sum calculated:\n");
+            hexdump(sm3_hash, SM3_DIGEST_SIZE);
+            digests[nr_digests++] = (struct tpm_pcr_digest){ TPM_ALG_SM3_256,
+                                                             sm3_hash };
+        }
+#endif
+
+        /* A TPM with only banks SKL can't hash */
+        if ( nr_digests == 0 )
+            goto fail;
+
+        /*
+         * The TPM executes the extend while the caller hashes the next
+         * region; the next tpmlib call waits for it.  So the result of the
+         * last extend is only known now, and this one's by the next.
+         */
+        check_extends(tpm);
+        if ( tpm_extend_pcr_submit(tpm, pcr, digests, nr_digests) < 0 )
+            goto fail;
+
+        log_event_tpm20(pcr, digests, nr_digests, ev);
+    }
+
+out:
     print("PCR extended\n");
+    return;
+
+fail:
+    print("PCR extend failed, not logged\n");
+}
+
+static void extend_pcr(struct tpm *tpm, void *data, u32 size, u32 pcr, char *ev)
+{
+    check_measured(data, size);
+    __extend_pcr(tpm, data, size, pcr, ev, NULL, NULL);
+}
+
+/* Regions to hash together, when the SHA-256 lanes or APs are worth using. */
+#define MEASURE_BATCH (2 * SHA256_MB_LANES)
+
+struct measurement {
+    void *data;
+    u32 size;
+    char *ev;
+};
+
+static bool batch_measurements(struct tpm *tpm)
+{
+    /* No point hashing ahead if the TPM will do it anyway */
+    if ( tpm_hashes(tpm, ~0U) )
+        return false;
+
+    /*
+     * Without APs, only the SHA-256 lanes make batching pay, so a TPM with
+     * no SHA-256 bank, or a CPU without the lanes, keeps the single fused
+     * SHA-1/SHA-256 pass of extend_pcr().
+     */
+    return smp_active() || ((tpm_pcr_banks(tpm) & TPM_BANK(TPM_ALG_SHA256))
+                            && sha256_mb_available());
+}
+
+/*
+ * The digests of all regions in the batch are calculated together, either
+ * the SHA-1 and SHA-256 of each on any CPU, or the SHA-256 of all in SIMD
+ * lanes, for whichever of those banks the TPM has.  Then each region is
+ * extended and logged in order as extend_pcr() would, so PCR values and the
+ * event log are unchanged.
+ *
+ * In the SIMD case a SHA-1 bank costs a second walk over each region, in
+ * __extend_pcr().  `make bench SIMD=y` compares that (sha256mb+sha1) with
+ * the fused pass (sha1sha256-sw): past a few KiB the lanes come out ahead,
+ * and modules are well past that.
+ */
+static void extend_batch(struct tpm *tpm, struct measurement *m,
+                         unsigned int n, u32 pcr)
+{
+    static u8 sha1[MEASURE_BATCH][SHA1_DIGEST_SIZE];
+    static u8 sha256[MEASURE_BATCH][SHA256_DIGEST_SIZE];
+    static struct hash_job jobs[2 * MEASURE_BATCH];
+    static const void *data[MEASURE_BATCH];
+    static u32 len[MEASURE_BATCH];
+    unsigned int i, nr_jobs = 0;
+    bool smp = smp_active();
+    bool do_sha1 = tpm_pcr_banks(tpm) & TPM_BANK(TPM_ALG_SHA1);
+    bool do_sha256 = tpm_pcr_banks(tpm) & TPM_BANK(TPM_ALG_SHA256);
+
+    for ( i = 0; i < n; i++ )
+    {
+        check_measured(m[i].data, m[i].size);
+
+        data[i] = m[i].data;
+        len[i] = m[i].size;
+
+        if ( smp )
+        {
+            /* Separate jobs, so the two streams run on different CPUs. */
+            if ( do_sha1 )
+                jobs[nr_jobs++] = (struct hash_job){
+                    .data = data[i], .size = len[i], .sha1 = sha1[i] };
+            if ( do_sha256 )
+                jobs[nr_jobs++] = (struct hash_job){
+                    .data = data[i], .size = len[i], .sha256 = sha256[i] };
+        }
+    }
+
+    if ( smp )
+        smp_hash(jobs, nr_jobs);
+    else
+        sha256sum_mb(sha256, data, len, n);
+
+    for ( i = 0; i < n; i++ )
+        __extend_pcr(tpm, m[i].data, m[i].size, pcr, m[i].ev,
+                     smp && do_sha1 ? sha1[i] : NULL,
+                     do_sha256 ? sha256[i] : NULL);
+}
+
+/* extend_pcr(), but with the two streams on different CPUs if possible */
+static void extend_pcr_image(struct tpm *tpm, void *data, u32 size, u32 pcr,
+                             char *ev)
+{
+    struct measurement m = { data, size, ev };
+
+    if ( smp_active() && !tpm_hashes(tpm, size) )
+        extend_batch(tpm, &m, 1, pcr);
+    else
+        extend_pcr(tpm, data, size, pcr, ev);
 }
 
 /*
@@ -102,17 +453,6 @@ static inline void *get_kernel_entry(struct boot_params *bp,
     return is_in_kernel(bp, _p(bp->code32_start + mle_hdr->sl_stub_entry));
 }
 
-/*
- * Even though die() has both __attribute__((noreturn)) and unreachable(),
- * Clang still complains if it isn't repeated here.
- */
-static void __attribute__((noreturn)) reboot(void)
-{
-    print("Rebooting now...");
-    die();
-    unreachable();
-}
-
 #ifdef TEST_DMA
 static void do_dma(void)
 {
@@ -153,9 +493,11 @@ static void do_dma(void)
 }
 #endif
 
-static void iommu_setup(void)
+/* Returns whether the IOMMU now keeps devices away from memory. */
+static bool iommu_setup(void)
 {
     u32 iommu_cap;
+    bool protected = false;
     volatile u64 iommu_done __attribute__ ((aligned (8))) = 0;
 
 #ifdef TEST_DMA
@@ -241,6 +583,7 @@ static void iommu_setup(void)
             print(".");
 
         print("\nIOMMU set\n");
+        protected = true;
     }
 
 #ifdef TEST_DMA
@@ -266,6 +609,8 @@ static void iommu_setup(void)
     print("and again2\n");
     hexdump(_p(0), 0x30);
 #endif
+
+    return protected;
 }
 
 /*
@@ -290,8 +635,12 @@ static asm_return_t skl_linux(struct tpm *tpm, struct skl_tag_boot_linux *skl_ta
     /* The Zero Page with the boot_params and legacy header */
     bp = _p(skl_tag->zero_page);
 
-    /* Disable memory protection and setup IOMMU */
-    iommu_setup();
+    /*
+     * Disable memory protection and setup IOMMU.  Only once DMA can't reach
+     * the SMP region may APs run from it.
+     */
+    if ( iommu_setup() )
+        smp_start();
 
     print("\ncode32_start ");
     print_p(_p(bp->code32_start));
@@ -321,8 +670,8 @@ static asm_return_t skl_linux(struct tpm *tpm, struct skl_tag_boot_linux *skl_ta
     }
 
     /* extend TB Loader code segment into PCR17 */
-    extend_pcr(tpm, _p(bp->code32_start), bp->syssize << 4, 17,
-               "Measured Kernel into PCR17");
+    extend_pcr_image(tpm, _p(bp->code32_start), bp->syssize << 4, 17,
+                     "Measured Kernel into PCR17");
 
     tpm_relinquish_locality(tpm);
     free_tpm(tpm);
@@ -348,6 +697,9 @@ static asm_return_t skl_linux(struct tpm *tpm, struct skl_tag_boot_linux *skl_ta
 
 static asm_return_t skl_multiboot2(struct tpm *tpm, struct skl_tag_boot_mb2 *skl_tag)
 {
+    static struct measurement mods[MEASURE_BATCH];
+    unsigned int nr_mods = 0;
+    bool batch;
     void *kernel_entry;
     u32 kernel_size, mbi_len;
     struct multiboot_tag *tag;
@@ -362,8 +714,13 @@ static asm_return_t skl_multiboot2(struct tpm *tpm, struct skl_tag_boot_mb2 *skl
     kernel_size = skl_tag->kernel_size;
     kernel_entry = _p(skl_tag->kernel_entry);
 
-    /* Disable memory protection and setup IOMMU */
-    iommu_setup();
+    /*
+     * Disable memory protection and setup IOMMU.  Only once DMA can't reach
+     * the SMP region may APs run from it.
+     */
+    if ( iommu_setup() )
+        smp_start();
+    batch = batch_measurements(tpm);
 
     /* Extend PCR18 with MBI structure's hash; this includes all cmdlines.
      * Use 'type' and not 'size', as their offsets are swapped in the header! */
@@ -414,8 +771,8 @@ static asm_return_t skl_multiboot2(struct tpm *tpm, struct skl_tag_boot_mb2 *skl
         tag = multiboot_next_tag(tag);
     }
 
-    extend_pcr(tpm, kernel_entry, kernel_size, 17,
-               "Measured Kernel into PCR17");
+    extend_pcr_image(tpm, kernel_entry, kernel_size, 17,
+                     "Measured Kernel into PCR17");
 
     tag = _p(skl_tag->mbi);
     tag++;
@@ -431,13 +788,29 @@ static asm_return_t skl_multiboot2(struct tpm *tpm, struct skl_tag_boot_mb2 *skl
             print_p(_p(mod->mod_start));
             print_p(_p(mod->mod_end));
             print("]\n");
-            extend_pcr(tpm, _p(mod->mod_start), mod->mod_end - mod->mod_start,
-                       17, mod->cmdline);
+
+            if ( !batch )
+                extend_pcr(tpm, _p(mod->mod_start),
+                           mod->mod_end - mod->mod_start, 17, mod->cmdline);
+            else
+            {
+                mods[nr_mods++] = (struct measurement){
+                    _p(mod->mod_start), mod->mod_end - mod->mod_start,
+                    mod->cmdline };
+                if ( nr_mods == MEASURE_BATCH )
+                {
+                    extend_batch(tpm, mods, nr_mods, 17);
+                    nr_mods = 0;
+                }
+            }
         }
 
         tag = multiboot_next_tag(tag);
     }
 
+    if ( nr_mods )
+        extend_batch(tpm, mods, nr_mods, 17);
+
     /* Safety checks */
     if ( tag->size != 8
          || _p(multiboot_next_tag(tag)) > _p(skl_tag->mbi) + mbi_len )
@@ -451,6 +824,38 @@ static asm_return_t skl_multiboot2(struct tpm *tpm, struct skl_tag_boot_mb2 *skl
     return (asm_return_t){ kernel_entry, _p(skl_tag->mbi) };
 }
 
+#ifdef ENABLE_TPM_TRACE
+/* Trace tpmlib into the bootloader's SKL_TAG_TPM_TRACE region, if any */
+static void tpm_trace_setup(void)
+{
+    struct skl_tag_tpm_trace *t = next_of_type(&bootloader_data,
+                                               SKL_TAG_TPM_TRACE);
+    void *region;
+
+    if ( t == NULL )
+        return;
+
+    region = _p(t->address);
+
+    /*
+     * As for the event log, SKL must not be made to overwrite itself, nor the
+     * other regions it writes.  What it measures is checked as it does.
+     */
+    if ( t->hdr.len != sizeof(*t)
+         || t->address + t->size < t->address
+         || (region < _p(_start + SLB_SIZE) && region + t->size > _p(_start))
+         || overlaps_skl_region(t->address, t->size, t) )
+    {
+        print("Bad TPM trace region, not tracing\n");
+        return;
+    }
+
+    tpm_trace_init(region, t->size);
+}
+#else
+static inline void tpm_trace_setup(void) {}
+#endif
+
 asm_return_t skl_main(void)
 {
     asm_return_t ret;
@@ -481,9 +886,10 @@ asm_return_t skl_main(void)
      * report the error unless SKINIT has some resource to do this. For
      * now, if an error is returned, this code will most likely just crash.
      */
+    tpm_trace_setup();
     tpm = enable_tpm();
     tpm_request_locality(tpm, 2);
-    event_log_init(tpm);
+    event_log_init(tpm, extended_banks(tpm));
 
     /* Now that we have TPM and event log, measure bootloader data */
     extend_pcr(tpm, &bootloader_data, bootloader_data.size, 18,
@@ -509,6 +915,11 @@ asm_return_t skl_main(void)
         reboot();
     }
 
+    /* The kernel expects to find the APs waiting for SIPI, as SKINIT left them */
+    smp_stop();
+
+    /* The result of the last extend */
+    check_extends(tpm);
     tpm_relinquish_locality(tpm);
     free_tpm(tpm);
 
@@ -23,10 +23,12 @@
 */
 
 #include <byteswap.h>
+#include <cpu.h>
 #include <defs.h>
 #include <types.h>
 #include <errno-base.h>
 #include <sha1sum.h>
+#include <simd.h>
 #include <string.h>
 
 static inline u32 rol( u32 x, int n)
@@ -34,18 +36,9 @@ static inline u32 rol( u32 x, int n)
     return (x << n) | (x >> (-n & 31));
 }
 
-typedef struct {
-    u32 count;
-    union {
-        struct {
-            u32 h0, h1, h2, h3, h4;
-        };
-        u32 h[5];
-    };
-    unsigned char buf[64];
-} SHA1_CONTEXT;
+typedef struct sha1_state SHA1_CONTEXT;
 
-static void sha1_init( SHA1_CONTEXT *hd )
+void sha1_init( SHA1_CONTEXT *hd )
 {
     *hd = (SHA1_CONTEXT){
         .h0 = 0x67452301,
@@ -65,6 +58,74 @@ static u32 sha1_blend(u32 *x, unsigned int i)
 #undef X
 }
 
+#define K1  0x5A827999L
+#define K2  0x6ED9EBA1L
+#define K3  0x8F1BBCDCL
+#define K4  0xCA62C1D6L
+#define F1(x,y,z)   ( z ^ ( x & ( y ^ z ) ) )
+#define F2(x,y,z)   ( x ^ y ^ z )
+#define F3(x,y,z)   ( ( x & y ) | ( z & ( x | y ) ) )
+#define F4(x,y,z)   ( x ^ y ^ z )
+
+
+#define M(i) sha1_blend(x, i)
+#define R(a,b,c,d,e,f,k,m)  do { e += rol( a, 5 )     \
+                      + f( b, c, d )  \
+                      + k         \
+                      + m;        \
+                 b = rol( b, 30 );    \
+                   } while(0)
+
+#ifdef ENABLE_SIMD
+/*
+ * With SIMD=y the vector transforms do the work on anything with SSSE3, so
+ * this is only a fallback, rolled up to leave room for them in the SLB.
+ */
+static void sha1_transform(SHA1_CONTEXT *hd, const void *_data)
+{
+    const u32 *data = _data;
+    u32 a, b, c, d, e, f, k, t;
+    u32 x[16];
+    unsigned int i;
+
+    for ( i = 0; i < 16; ++i )
+        x[i] = cpu_to_be32(data[i]);
+
+    a = hd->h0;  b = hd->h1;  c = hd->h2;  d = hd->h3;  e = hd->h4;
+
+    for ( i = 0; i < 80; ++i )
+    {
+        if ( i >= 16 )
+            sha1_blend(x, i);
+
+        if ( i < 20 )
+        {
+            f = F1(b, c, d);
+            k = K1;
+        }
+        else if ( i < 40 )
+        {
+            f = F2(b, c, d);
+            k = K2;
+        }
+        else if ( i < 60 )
+        {
+            f = F3(b, c, d);
+            k = K3;
+        }
+        else
+        {
+            f = F4(b, c, d);
+            k = K4;
+        }
+
+        t = rol(a, 5) + f + e + k + x[i & 15];
+        e = d;  d = c;  c = rol(b, 30);  b = a;  a = t;
+    }
+
+    hd->h0 += a;  hd->h1 += b;  hd->h2 += c;  hd->h3 += d;  hd->h4 += e;
+}
+#else
 /****************
  * Transform the message X which consists of 16 32-bit-words
  */
@@ -85,25 +146,6 @@ static void sha1_transform(SHA1_CONTEXT *hd, const void *_data)
     for ( i = 0; i < 16; ++i )
         x[i] = cpu_to_be32(data[i]);
 
-
-#define K1  0x5A827999L
-#define K2  0x6ED9EBA1L
-#define K3  0x8F1BBCDCL
-#define K4  0xCA62C1D6L
-#define F1(x,y,z)   ( z ^ ( x & ( y ^ z ) ) )
-#define F2(x,y,z)   ( x ^ y ^ z )
-#define F3(x,y,z)   ( ( x & y ) | ( z & ( x | y ) ) )
-#define F4(x,y,z)   ( x ^ y ^ z )
-
-
-#define M(i) sha1_blend(x, i)
-#define R(a,b,c,d,e,f,k,m)  do { e += rol( a, 5 )     \
-                      + f( b, c, d )  \
-                      + k         \
-                      + m;        \
-                 b = rol( b, 30 );    \
-                   } while(0)
-
     for ( i = 0; i < 15; i += 5 )
     {
         R(a, b, c, d, e, F1, K1, x[i + 0]);
@@ -153,15 +195,209 @@ static void sha1_transform(SHA1_CONTEXT *hd, const void *_data)
     hd->h3 += d;
     hd->h4 += e;
 }
+#endif /* ENABLE_SIMD */
+
+/*
+ * SHA-NI version of sha1_transform(), for several blocks at once.  Each
+ * SHA1RNDS4 performs 4 rounds, SHA1MSG1/SHA1MSG2 expand the next 4 message
+ * words from the previous 16, and SHA1NEXTE derives E for the next 4 rounds.
+ */
+#define SHA1_NI_ROUNDS(i, f)                                                \
+    do {                                                                    \
+        if ( (i) >= 4 )                                                     \
+            m[(i) & 3] = _mm_sha1msg2_epu32(                                \
+                _mm_xor_si128(_mm_sha1msg1_epu32(m[(i) & 3],                \
+                                                 m[((i) + 1) & 3]),         \
+                              m[((i) + 2) & 3]),                            \
+                m[((i) + 3) & 3]);                                          \
+        e = (i) ? _mm_sha1nexte_epu32(e, m[(i) & 3])                        \
+                : _mm_add_epi32(e, m[0]);                                   \
+        tmp = abcd;                                                         \
+        abcd = _mm_sha1rnds4_epu32(abcd, e, f);                             \
+        e = tmp;                                                            \
+    } while ( 0 )
+
+static void __attribute__((target("sha,sse4.1")))
+sha1_transform_ni(SHA1_CONTEXT *hd, const void *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+    __m128i abcd, e, abcd_save, e_save, tmp, m[4];
+    unsigned int i;
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((void *)hd->h), 0x1b);
+    e = _mm_set_epi32(hd->h4, 0, 0, 0);
+
+    for ( ; blocks; data += 64, blocks-- )
+    {
+        abcd_save = abcd;
+        e_save = e;
+
+        for ( i = 0; i < 4; i++ )
+            m[i] = _mm_shuffle_epi8(_mm_loadu_si128(data + 16 * i), mask);
+
+#pragma GCC unroll 5
+        for ( i = 0; i < 5; i++ )
+            SHA1_NI_ROUNDS(i, 0);
+#pragma GCC unroll 5
+        for ( ; i < 10; i++ )
+            SHA1_NI_ROUNDS(i, 1);
+#pragma GCC unroll 5
+        for ( ; i < 15; i++ )
+            SHA1_NI_ROUNDS(i, 2);
+#pragma GCC unroll 5
+        for ( ; i < 20; i++ )
+            SHA1_NI_ROUNDS(i, 3);
+
+        e = _mm_sha1nexte_epu32(e, e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((void *)hd->h, _mm_shuffle_epi32(abcd, 0x1b));
+    hd->h4 = _mm_extract_epi32(e, 3);
+}
+
+#undef SHA1_NI_ROUNDS
+
+/*
+ * For CPUs with SSSE3 but not the SHA extensions: the rounds stay scalar, but
+ * the message schedule is computed 4 words at a time and with the round
+ * constant already added, as in Intel's "Improving the Performance of the
+ * Secure Hash Algorithm (SHA-1)".  The recurrence refers back 3 words, so
+ * words 16-31 need the last lane of each vector patching up, and from word 32
+ * onwards the equivalent
+ *
+ *   W[i] = rol(W[i-6] ^ W[i-16] ^ W[i-28] ^ W[i-32], 2)
+ *
+ * has no dependencies within a vector.  w[] holds the last 8 vectors.
+ */
+static inline __m128i __attribute__((target("ssse3")))
+sha1_rol_epi32(__m128i x, int n)
+{
+    return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n));
+}
+
+static inline __m128i __attribute__((target("ssse3")))
+sha1_schedule_ssse3(__m128i *w, const void *data, unsigned int i)
+{
+#define W(i) w[(i) & 7]
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i x;
+
+    if ( i < 4 )
+        x = _mm_shuffle_epi8(_mm_loadu_si128(data + 16 * i), mask);
+    else if ( i < 8 )
+    {
+        x = _mm_xor_si128(_mm_xor_si128(_mm_srli_si128(W(i - 1), 4), W(i - 2)),
+                          _mm_xor_si128(_mm_alignr_epi8(W(i - 3), W(i - 4), 8),
+                                        W(i - 4)));
+        x = sha1_rol_epi32(x, 1);
+        /* Lane 3 was computed with 0 in place of W[4i], from lane 0 */
+        x = _mm_xor_si128(x, sha1_rol_epi32(_mm_slli_si128(x, 12), 1));
+    }
+    else
+        x = sha1_rol_epi32(
+            _mm_xor_si128(_mm_xor_si128(_mm_alignr_epi8(W(i - 1), W(i - 2), 8),
+                                        W(i - 4)),
+                          _mm_xor_si128(W(i - 7), W(i - 8))), 2);
+
+    return W(i) = x;
+#undef W
+}
+
+/* Schedule vectors 5p to 5p + 4, then perform the corresponding 20 rounds */
+#define SHA1_SSSE3_ROUNDS(p, f, k)                                          \
+    do {                                                                    \
+        for ( i = 0; i < 5; i++ )                                           \
+            _mm_storeu_si128((void *)&wk[4 * i],                            \
+                _mm_add_epi32(sha1_schedule_ssse3(w, data, 5 * (p) + i),    \
+                              _mm_set1_epi32(k)));                          \
+                                                                            \
+        for ( i = 0; i < 20; i += 5 )                                       \
+        {                                                                   \
+            R(a, b, c, d, e, f, 0, wk[i + 0]);                              \
+            R(e, a, b, c, d, f, 0, wk[i + 1]);                              \
+            R(d, e, a, b, c, f, 0, wk[i + 2]);                              \
+            R(c, d, e, a, b, f, 0, wk[i + 3]);                              \
+            R(b, c, d, e, a, f, 0, wk[i + 4]);                              \
+        }                                                                   \
+    } while ( 0 )
+
+static void __attribute__((target("ssse3")))
+sha1_transform_ssse3(SHA1_CONTEXT *hd, const void *data, size_t blocks)
+{
+    __m128i w[8];
+    u32 a, b, c, d, e, wk[20];
+    unsigned int i;
+
+    for ( ; blocks; data += 64, blocks-- )
+    {
+        a = hd->h0;
+        b = hd->h1;
+        c = hd->h2;
+        d = hd->h3;
+        e = hd->h4;
+
+        SHA1_SSSE3_ROUNDS(0, F1, K1);
+        SHA1_SSSE3_ROUNDS(1, F2, K2);
+        SHA1_SSSE3_ROUNDS(2, F3, K3);
+        SHA1_SSSE3_ROUNDS(3, F4, K4);
+
+        hd->h0 += a;
+        hd->h1 += b;
+        hd->h2 += c;
+        hd->h3 += d;
+        hd->h4 += e;
+    }
+}
 
+#undef SHA1_SSSE3_ROUNDS
 
-static void sha1_once(SHA1_CONTEXT *hd, const void *data, u32 len)
+static void sha1_blocks(SHA1_CONTEXT *hd, const void *data, size_t blocks)
 {
-    hd->count = len;
-    for ( ; len >= 64; data += 64, len -= 64 )
+    if ( cpu_has_sha() )
+    {
+        sha1_transform_ni(hd, data, blocks);
+        return;
+    }
+
+    if ( cpu_has_ssse3() )
+    {
+        sha1_transform_ssse3(hd, data, blocks);
+        return;
+    }
+
+    for ( ; blocks; data += 64, blocks-- )
         sha1_transform(hd, data);
+}
+
+void sha1_update(SHA1_CONTEXT *hd, const void *data, size_t len)
+{
+    unsigned int partial = hd->count & 0x3f;
+
+    hd->count += len;
+
+    /* Top up a block left over from the previous call first */
+    if ( partial )
+    {
+        unsigned int fill = 64 - partial;
+
+        if ( len < fill )
+        {
+            memcpy(hd->buf + partial, data, len);
+            return;
+        }
+
+        memcpy(hd->buf + partial, data, fill);
+        sha1_transform(hd, hd->buf);
+        data += fill;
+        len -= fill;
+    }
+
+    sha1_blocks(hd, data, len / 64);
 
-    memcpy(hd->buf, data, len);
+    memcpy(hd->buf, data + (len & ~63), len & 63);
 }
 
 
@@ -172,8 +408,7 @@ static void sha1_once(SHA1_CONTEXT *hd, const void *data, u32 len)
  * Returns: 20 bytes representing the digest.
  */
 
-static void
-sha1_final(SHA1_CONTEXT *hd, u8 hash[SHA1_DIGEST_SIZE])
+void sha1_final(SHA1_CONTEXT *hd, u8 hash[SHA1_DIGEST_SIZE])
 {
     unsigned int partial = hd->count & 0x3f;
 
@@ -192,7 +427,7 @@ sha1_final(SHA1_CONTEXT *hd, u8 hash[SHA1_DIGEST_SIZE])
 
     /* append the 64 bit count */
     u64 *count = (void *)&hd->buf[56];
-    *count = cpu_to_be64((u64)hd->count << 3);
+    *count = cpu_to_be64(hd->count << 3);
     sha1_transform(hd, hd->buf);
 
     u32 *p = (void *)hash;
@@ -205,7 +440,7 @@ void sha1sum(u8 hash[static SHA1_DIGEST_SIZE], const void *ptr, u32 len)
     SHA1_CONTEXT ctx;
 
     sha1_init(&ctx);
-    sha1_once(&ctx, ptr, len);
+    sha1_update(&ctx, ptr, len);
     sha1_final(&ctx, hash);
 }
 
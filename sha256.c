@@ -16,18 +16,12 @@
  */
 
 #include <byteswap.h>
+#include <cpu.h>
 #include <types.h>
 #include <sha256.h>
+#include <simd.h>
 #include <string.h>
 
-#define SHA256_BLOCK_SIZE   64
-
-struct sha256_state {
-    u32 state[SHA256_DIGEST_SIZE / 4];
-    u32 count;
-    u8 buf[SHA256_BLOCK_SIZE];
-};
-
 static inline u32 ror32(u32 word, unsigned int shift)
 {
     return (word >> shift) | (word << (32 - shift));
@@ -76,12 +70,45 @@ static const u32 K[] = {
     0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
 };
 
+#ifdef ENABLE_SIMD
+/*
+ * With SIMD=y the vector transforms do the work on anything with SSSE3, so
+ * this is only a fallback, rolled up to leave room for them in the SLB.
+ */
 static void sha256_transform(u32 *state, const void *_input)
 {
     const u32 *input = _input;
     u32 a, b, c, d, e, f, g, h, t1, t2;
     u32 W[16];
-    int i;
+    unsigned int i;
+
+    for ( i = 0; i < 16; i++ )
+        W[i] = be32_to_cpu(input[i]);
+
+    a = state[0];  b = state[1];  c = state[2];  d = state[3];
+    e = state[4];  f = state[5];  g = state[6];  h = state[7];
+
+    for ( i = 0; i < 64; i++ )
+    {
+        if ( i >= 16 )
+            sha256_blend(W, i);
+
+        t1 = h + e1(e) + Ch(e, f, g) + K[i] + W[i & 15];
+        t2 = e0(a) + Maj(a, b, c);
+        h = g;  g = f;  f = e;  e = d + t1;
+        d = c;  c = b;  b = a;  a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+#else
+static void sha256_transform(u32 *state, const void *_input)
+{
+    const u32 *input = _input;
+    u32 a, b, c, d, e, f, g, h, t1, t2;
+    u32 W[16];
+    unsigned int i, j;
 
     /* load the input */
     for ( i = 0; i < 16; i++ )
@@ -92,76 +119,237 @@ static void sha256_transform(u32 *state, const void *_input)
     e = state[4];  f = state[5];  g = state[6];  h = state[7];
 
     /* now iterate */
-    for ( i = 0; i < 16; i += 8 )
+    for ( i = 0; i < 64; i += 8 )
     {
-        t1 = h + e1(e) + Ch(e, f, g) + K[i + 0] + W[i + 0];
+        /* expand the next 8 words of the message schedule */
+        if ( i >= 16 )
+            for ( j = 0; j < 8; j++ )
+                sha256_blend(W, i + j);
+
+        t1 = h + e1(e) + Ch(e, f, g) + K[i + 0] + W[(i + 0) & 15];
         t2 = e0(a) + Maj(a, b, c);    d += t1;    h = t1 + t2;
-        t1 = g + e1(d) + Ch(d, e, f) + K[i + 1] + W[i + 1];
+        t1 = g + e1(d) + Ch(d, e, f) + K[i + 1] + W[(i + 1) & 15];
         t2 = e0(h) + Maj(h, a, b);    c += t1;    g = t1 + t2;
-        t1 = f + e1(c) + Ch(c, d, e) + K[i + 2] + W[i + 2];
+        t1 = f + e1(c) + Ch(c, d, e) + K[i + 2] + W[(i + 2) & 15];
         t2 = e0(g) + Maj(g, h, a);    b += t1;    f = t1 + t2;
-        t1 = e + e1(b) + Ch(b, c, d) + K[i + 3] + W[i + 3];
+        t1 = e + e1(b) + Ch(b, c, d) + K[i + 3] + W[(i + 3) & 15];
         t2 = e0(f) + Maj(f, g, h);    a += t1;    e = t1 + t2;
-        t1 = d + e1(a) + Ch(a, b, c) + K[i + 4] + W[i + 4];
+        t1 = d + e1(a) + Ch(a, b, c) + K[i + 4] + W[(i + 4) & 15];
         t2 = e0(e) + Maj(e, f, g);    h += t1;    d = t1 + t2;
-        t1 = c + e1(h) + Ch(h, a, b) + K[i + 5] + W[i + 5];
+        t1 = c + e1(h) + Ch(h, a, b) + K[i + 5] + W[(i + 5) & 15];
         t2 = e0(d) + Maj(d, e, f);    g += t1;    c = t1 + t2;
-        t1 = b + e1(g) + Ch(g, h, a) + K[i + 6] + W[i + 6];
+        t1 = b + e1(g) + Ch(g, h, a) + K[i + 6] + W[(i + 6) & 15];
         t2 = e0(c) + Maj(c, d, e);    f += t1;    b = t1 + t2;
-        t1 = a + e1(f) + Ch(f, g, h) + K[i + 7] + W[i + 7];
+        t1 = a + e1(f) + Ch(f, g, h) + K[i + 7] + W[(i + 7) & 15];
         t2 = e0(b) + Maj(b, c, d);    e += t1;    a = t1 + t2;
     }
 
-    for ( ; i < 64; i += 8 )
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+#endif /* ENABLE_SIMD */
+
+/*
+ * SHA-NI version of sha256_transform(), for several blocks at once.  The
+ * state lives in two registers as ABEF and CDGH, each SHA256RNDS2 performs 2
+ * rounds, and SHA256MSG1/SHA256MSG2 expand the next 4 message words.
+ */
+static void __attribute__((target("sha,sse4.1")))
+sha256_transform_ni(u32 *state, const void *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i abef, cdgh, abef_save, cdgh_save, tmp, m[4];
+    unsigned int i;
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((void *)&state[0]), 0xb1);
+    cdgh = _mm_shuffle_epi32(_mm_loadu_si128((void *)&state[4]), 0x1b);
+    abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xf0);
+
+    for ( ; blocks; data += 64, blocks-- )
     {
-        t1 = h + e1(e) + Ch(e, f, g) + K[i + 0] + sha256_blend(W, i + 0);
-        t2 = e0(a) + Maj(a, b, c);    d += t1;    h = t1+t2;
-        t1 = g + e1(d) + Ch(d, e, f) + K[i + 1] + sha256_blend(W, i + 1);
-        t2 = e0(h) + Maj(h, a, b);    c += t1;    g = t1+t2;
-        t1 = f + e1(c) + Ch(c, d, e) + K[i + 2] + sha256_blend(W, i + 2);
-        t2 = e0(g) + Maj(g, h, a);    b += t1;    f = t1+t2;
-        t1 = e + e1(b) + Ch(b, c, d) + K[i + 3] + sha256_blend(W, i + 3);
-        t2 = e0(f) + Maj(f, g, h);    a += t1;    e = t1+t2;
-        t1 = d + e1(a) + Ch(a, b, c) + K[i + 4] + sha256_blend(W, i + 4);
-        t2 = e0(e) + Maj(e, f, g);    h += t1;    d = t1+t2;
-        t1 = c + e1(h) + Ch(h, a, b) + K[i + 5] + sha256_blend(W, i + 5);
-        t2 = e0(d) + Maj(d, e, f);    g += t1;    c = t1+t2;
-        t1 = b + e1(g) + Ch(g, h, a) + K[i + 6] + sha256_blend(W, i + 6);
-        t2 = e0(c) + Maj(c, d, e);    f += t1;    b = t1+t2;
-        t1 = a + e1(f) + Ch(f, g, h) + K[i + 7] + sha256_blend(W, i + 7);
-        t2 = e0(b) + Maj(b, c, d);    e += t1;    a = t1+t2;
+        abef_save = abef;
+        cdgh_save = cdgh;
+
+#pragma GCC unroll 16
+        for ( i = 0; i < 16; i++ )
+        {
+            if ( i < 4 )
+                m[i] = _mm_shuffle_epi8(_mm_loadu_si128(data + 16 * i), mask);
+            else
+                m[i & 3] = _mm_sha256msg2_epu32(
+                    _mm_add_epi32(_mm_sha256msg1_epu32(m[i & 3],
+                                                       m[(i + 1) & 3]),
+                                  _mm_alignr_epi8(m[(i + 3) & 3],
+                                                  m[(i + 2) & 3], 4)),
+                    m[(i + 3) & 3]);
+
+            tmp = _mm_add_epi32(m[i & 3], _mm_loadu_si128((void *)&K[4 * i]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, tmp);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh,
+                                         _mm_shuffle_epi32(tmp, 0x0e));
+        }
+
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
     }
 
-    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
-    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    tmp = _mm_shuffle_epi32(abef, 0x1b);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((void *)&state[0], _mm_blend_epi16(tmp, cdgh, 0xf0));
+    _mm_storeu_si128((void *)&state[4], _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+/*
+ * For CPUs with SSSE3 but not the SHA extensions: the rounds stay scalar, but
+ * the message schedule is computed 4 words at a time and with K[] already
+ * added, as in Intel's "Fast SHA-256 Implementations on Intel Architecture
+ * Processors".  sigma1 refers back only 2 words, so it is applied to each
+ * half of the vector in turn.  w[] holds the last 4 vectors.
+ */
+static inline __m128i __attribute__((target("ssse3")))
+sha256_ror_epi32(__m128i x, int n)
+{
+    return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n));
+}
+
+static inline __m128i __attribute__((target("ssse3")))
+sha256_s1_epi32(__m128i x)
+{
+    return _mm_xor_si128(_mm_xor_si128(sha256_ror_epi32(x, 17),
+                                       sha256_ror_epi32(x, 19)),
+                         _mm_srli_epi32(x, 10));
+}
+
+static inline __m128i __attribute__((target("ssse3")))
+sha256_schedule_ssse3(__m128i *w, const void *data, unsigned int i)
+{
+#define W(i) w[(i) & 3]
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i x, s0;
+
+    if ( i < 4 )
+        return W(i) = _mm_shuffle_epi8(_mm_loadu_si128(data + 16 * i), mask);
+
+    /* W[i-16] + W[i-7] + s0(W[i-15]) */
+    s0 = _mm_alignr_epi8(W(i - 3), W(i - 4), 4);
+    s0 = _mm_xor_si128(_mm_xor_si128(sha256_ror_epi32(s0, 7),
+                                     sha256_ror_epi32(s0, 18)),
+                       _mm_srli_epi32(s0, 3));
+    x = _mm_add_epi32(_mm_add_epi32(W(i - 4), s0),
+                      _mm_alignr_epi8(W(i - 1), W(i - 2), 4));
+
+    /* s1(W[i-2]), for the low half from the previous vector, then the top */
+    x = _mm_add_epi32(x, sha256_s1_epi32(_mm_srli_si128(W(i - 1), 8)));
+    x = _mm_add_epi32(x, sha256_s1_epi32(_mm_slli_si128(x, 8)));
+
+    return W(i) = x;
+#undef W
+}
+
+static void __attribute__((target("ssse3")))
+sha256_transform_ssse3(u32 *state, const void *data, size_t blocks)
+{
+    u32 a, b, c, d, e, f, g, h, t1, t2;
+    u32 wk[16];
+    __m128i w[4];
+    unsigned int i, j;
+
+    for ( ; blocks; data += 64, blocks-- )
+    {
+        a = state[0];  b = state[1];  c = state[2];  d = state[3];
+        e = state[4];  f = state[5];  g = state[6];  h = state[7];
+
+        for ( i = 0; i < 64; i += 16 )
+        {
+            for ( j = 0; j < 4; j++ )
+                _mm_storeu_si128((void *)&wk[4 * j],
+                    _mm_add_epi32(sha256_schedule_ssse3(w, data, i / 4 + j),
+                                  _mm_loadu_si128((void *)&K[i + 4 * j])));
+
+            /* One round per iteration: unrolling costs 700 bytes for ~10% */
+            for ( j = 0; j < 16; j++ )
+            {
+                t1 = h + e1(e) + Ch(e, f, g) + wk[j];
+                t2 = e0(a) + Maj(a, b, c);
+
+                h = g;  g = f;  f = e;  e = d + t1;
+                d = c;  c = b;  b = a;  a = t1 + t2;
+            }
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
 }
 
-static void sha256_init(struct sha256_state *sctx)
+static void sha256_blocks(u32 *state, const void *data, size_t blocks)
 {
-    *sctx = (struct sha256_state){
-        .state = {
-            0x6a09e667UL,
-            0xbb67ae85UL,
-            0x3c6ef372UL,
-            0xa54ff53aUL,
-            0x510e527fUL,
-            0x9b05688cUL,
-            0x1f83d9abUL,
-            0x5be0cd19UL,
-        },
-    };
+    if ( cpu_has_sha() )
+    {
+        sha256_transform_ni(state, data, blocks);
+        return;
+    }
+
+    if ( cpu_has_ssse3() )
+    {
+        sha256_transform_ssse3(state, data, blocks);
+        return;
+    }
+
+    for ( ; blocks; data += 64, blocks-- )
+        sha256_transform(state, data);
 }
 
-static void sha256_once(struct sha256_state *sctx, const void *data, u32 len)
+static const u32 sha256_iv[] = {
+    0x6a09e667UL,
+    0xbb67ae85UL,
+    0x3c6ef372UL,
+    0xa54ff53aUL,
+    0x510e527fUL,
+    0x9b05688cUL,
+    0x1f83d9abUL,
+    0x5be0cd19UL,
+};
+
+void sha256_init(struct sha256_state *sctx)
 {
-    sctx->count = len;
-    for ( ; len >= 64; data += 64, len -= 64 )
-        sha256_transform(sctx->state, data);
+    memcpy(sctx->state, sha256_iv, sizeof(sctx->state));
+    sctx->count = 0;
+}
 
-    memcpy(sctx->buf, data, len);
+void sha256_update(struct sha256_state *sctx, const void *data, size_t len)
+{
+    unsigned int partial = sctx->count & 0x3f;
+
+    sctx->count += len;
+
+    /* Top up a block left over from the previous call first */
+    if ( partial )
+    {
+        unsigned int fill = SHA256_BLOCK_SIZE - partial;
+
+        if ( len < fill )
+        {
+            memcpy(sctx->buf + partial, data, len);
+            return;
+        }
+
+        memcpy(sctx->buf + partial, data, fill);
+        sha256_transform(sctx->state, sctx->buf);
+        data += fill;
+        len -= fill;
+    }
+
+    sha256_blocks(sctx->state, data, len / SHA256_BLOCK_SIZE);
+
+    memcpy(sctx->buf, data + (len & ~(SHA256_BLOCK_SIZE - 1)),
+           len & (SHA256_BLOCK_SIZE - 1));
 }
 
-static void sha256_final(struct sha256_state *sctx, void *_dst)
+void sha256_final(struct sha256_state *sctx, void *_dst)
 {
     u32 *dst = _dst;
     u64 *count;
@@ -182,7 +370,7 @@ static void sha256_final(struct sha256_state *sctx, void *_dst)
 
     /* Append the 64 bit count */
     count = (void *)&sctx->buf[56];
-    *count = cpu_to_be64((u64)sctx->count << 3);
+    *count = cpu_to_be64(sctx->count << 3);
     sha256_transform(sctx->state, sctx->buf);
 
     /* Store state in digest */
@@ -195,6 +383,181 @@ void sha256sum(u8 hash[static SHA256_DIGEST_SIZE], const void *data, u32 len)
     struct sha256_state sctx;
 
     sha256_init(&sctx);
-    sha256_once(&sctx, data, len);
+    sha256_update(&sctx, data, len);
+    sha256_final(&sctx, hash);
+}
+
+/*
+ * Multi-buffer SHA-256, for several independent buffers at once.  Each of the
+ * 4 lanes of an SSE2 register carries one buffer, so the rounds are the same
+ * as in sha256_transform() but a vector wide.  SSE2 has no rotate or byte
+ * swap, so those are done with shifts and while gathering the input.  This is
+ * only worth it without SHA-NI, which is faster on a single buffer.
+ */
+bool sha256_mb_available(void)
+{
+    return simd_enabled() && !cpu_has_sha();
+}
+
+static inline __m128i __attribute__((target("sse2")))
+sha256_x4_ror(__m128i x, int n)
+{
+    return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n));
+}
+
+#define X4_XOR3(x, y, z) _mm_xor_si128(_mm_xor_si128(x, y), z)
+
+/* state[] is transposed: state[i][lane] */
+static void __attribute__((target("sse2")))
+sha256_transform_x4(u32 state[8][SHA256_MB_LANES], const u8 **data,
+                    size_t blocks)
+{
+    __m128i v[8], W[16], t1, t2;
+    unsigned int i, l;
+
+    for ( ; blocks; blocks-- )
+    {
+        for ( i = 0; i < 8; i++ )
+            v[i] = _mm_loadu_si128((void *)state[i]);
+
+        for ( i = 0; i < 64; i++ )
+        {
+#define V(x) v[(x - i) & 7]
+#define W(x) W[(x) & 15]
+            if ( i < 16 )
+            {
+                for ( l = 0; l < SHA256_MB_LANES; l++ )
+                    ((u32 *)&W(i))[l] = be32_to_cpu(((u32 *)data[l])[i]);
+            }
+            else
+            {
+                t1 = W(i - 15);
+                t1 = X4_XOR3(sha256_x4_ror(t1, 7), sha256_x4_ror(t1, 18),
+                             _mm_srli_epi32(t1, 3));
+                t2 = W(i - 2);
+                t2 = X4_XOR3(sha256_x4_ror(t2, 17), sha256_x4_ror(t2, 19),
+                             _mm_srli_epi32(t2, 10));
+                W(i) = _mm_add_epi32(_mm_add_epi32(W(i), W(i - 7)),
+                                     _mm_add_epi32(t1, t2));
+            }
+
+            /* h + e1(e) + Ch(e, f, g) + K[i] + W[i] */
+            t1 = _mm_add_epi32(
+                _mm_add_epi32(V(7), X4_XOR3(sha256_x4_ror(V(4), 6),
+                                            sha256_x4_ror(V(4), 11),
+                                            sha256_x4_ror(V(4), 25))),
+                _mm_add_epi32(
+                    _mm_xor_si128(V(6), _mm_and_si128(V(4),
+                                                      _mm_xor_si128(V(5),
+                                                                    V(6)))),
+                    _mm_add_epi32(_mm_set1_epi32(K[i]), W(i))));
+
+            /* e0(a) + Maj(a, b, c) */
+            t2 = _mm_add_epi32(
+                X4_XOR3(sha256_x4_ror(V(0), 2), sha256_x4_ror(V(0), 13),
+                        sha256_x4_ror(V(0), 22)),
+                _mm_or_si128(_mm_and_si128(V(0), V(1)),
+                             _mm_and_si128(V(2), _mm_or_si128(V(0), V(1)))));
+
+            /* Rather than moving every variable, move the window */
+            V(3) = _mm_add_epi32(V(3), t1);
+            V(7) = _mm_add_epi32(t1, t2);
+#undef W
+#undef V
+        }
+
+        /* 64 rounds, so the window is back where it started */
+        for ( i = 0; i < 8; i++ )
+            _mm_storeu_si128((void *)state[i],
+                             _mm_add_epi32(_mm_loadu_si128((void *)state[i]),
+                                           v[i]));
+
+        for ( l = 0; l < SHA256_MB_LANES; l++ )
+            data[l] += SHA256_BLOCK_SIZE;
+    }
+}
+
+#undef X4_XOR3
+
+/* Hash the tail of a buffer whose whole blocks went through a lane */
+static void noinline sha256_mb_finish(u32 state[8][SHA256_MB_LANES],
+                                      unsigned int l, const u8 *tail, u32 len,
+                                      u8 *hash)
+{
+    struct sha256_state sctx;
+    unsigned int i;
+
+    for ( i = 0; i < 8; i++ )
+        sctx.state[i] = state[i][l];
+    sctx.count = len & ~(SHA256_BLOCK_SIZE - 1);
+    sha256_update(&sctx, tail, len & (SHA256_BLOCK_SIZE - 1));
     sha256_final(&sctx, hash);
 }
+
+void sha256sum_mb(u8 (*hash)[SHA256_DIGEST_SIZE], const void *const *data,
+                  const u32 *len, unsigned int n)
+{
+    u32 state[8][SHA256_MB_LANES];
+    const u8 *ptr[SHA256_MB_LANES], *busy;
+    u32 left[SHA256_MB_LANES], blocks = 0;
+    int job[SHA256_MB_LANES];
+    unsigned int next = 0, i, l;
+
+    if ( !sha256_mb_available() )
+    {
+        for ( i = 0; i < n; i++ )
+            sha256sum(hash[i], data[i], len[i]);
+        return;
+    }
+
+    for ( l = 0; l < SHA256_MB_LANES; l++ )
+        job[l] = -1;
+
+    for ( ;; )
+    {
+        /* Give idle lanes the next buffer */
+        for ( l = 0; l < SHA256_MB_LANES; l++ )
+        {
+            if ( job[l] >= 0 || next == n )
+                continue;
+
+            job[l] = next;
+            ptr[l] = data[next];
+            left[l] = len[next++] / SHA256_BLOCK_SIZE;
+            for ( i = 0; i < 8; i++ )
+                state[i][l] = sha256_iv[i];
+        }
+
+        busy = NULL;
+        for ( l = 0; l < SHA256_MB_LANES; l++ )
+            if ( job[l] >= 0 && (!busy || left[l] < blocks) )
+            {
+                blocks = left[l];
+                busy = ptr[l];
+            }
+
+        /* Every lane idle, so every buffer done */
+        if ( !busy )
+            break;
+
+        /*
+         * Idle lanes follow a busy one rather than reading past the end of
+         * their old buffer, which might run into MMIO.
+         */
+        for ( l = 0; l < SHA256_MB_LANES; l++ )
+            if ( job[l] < 0 )
+                ptr[l] = busy;
+
+        sha256_transform_x4(state, ptr, blocks);
+
+        /* Finish lanes which have run out of whole blocks on their own */
+        for ( l = 0; l < SHA256_MB_LANES; l++ )
+        {
+            if ( job[l] < 0 || (left[l] -= blocks) )
+                continue;
+
+            sha256_mb_finish(state, l, ptr[l], len[job[l]], hash[job[l]]);
+            job[l] = -1;
+        }
+    }
+}
@@ -0,0 +1,246 @@
+/*
+ * SHA-384 and SHA-512, as specified in
+ * http://csrc.nist.gov/groups/STM/cavp/documents/shs/sha256-384-512.pdf
+ *
+ * Based on the SHA-512 code by Jean-Luc Cooke <jlcooke@certainkey.com>.
+ *
+ * Copyright (c) Jean-Luc Cooke <jlcooke@certainkey.com>
+ * Copyright (c) Andrew McDonald <andrew@mcdonald.org.uk>
+ * Copyright (c) 2003 Kyle McMartin <kyle@debian.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <byteswap.h>
+#include <types.h>
+#include <sha512.h>
+#include <string.h>
+
+static inline u64 ror64(u64 word, unsigned int shift)
+{
+    return (word >> shift) | (word << (64 - shift));
+}
+
+static inline u64 Ch(u64 x, u64 y, u64 z)
+{
+    return z ^ (x & (y ^ z));
+}
+
+static inline u64 Maj(u64 x, u64 y, u64 z)
+{
+    return (x & y) | (z & (x | y));
+}
+
+#define e0(x)       (ror64(x, 28) ^ ror64(x, 34) ^ ror64(x, 39))
+#define e1(x)       (ror64(x, 14) ^ ror64(x, 18) ^ ror64(x, 41))
+#define s0(x)       (ror64(x, 1) ^ ror64(x, 8) ^ (x >> 7))
+#define s1(x)       (ror64(x, 19) ^ ror64(x, 61) ^ (x >> 6))
+
+static u64 sha512_blend(u64 *W, unsigned int i)
+{
+#define W(i) W[(i) & 15]
+
+    return W(i) += s1(W(i - 2)) + W(i - 7) + s0(W(i - 15));
+
+#undef W
+}
+
+static const u64 K[] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL,
+    0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+    0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+    0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL,
+    0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+    0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL,
+    0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL,
+    0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL,
+    0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL,
+    0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+    0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL,
+    0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+    0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+    0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL,
+    0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL,
+    0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+    0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+    0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL,
+    0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+    0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+/*
+ * Unlike sha256_transform(), one round per iteration.  The 64K limit leaves
+ * little room, and unrolling SHA-512's 80 rounds on 64 bit words costs over
+ * 1K for little gain; in long mode each word lives in a single register and
+ * the moves below are nearly free.
+ */
+static void sha512_transform(u64 *state, const void *_input)
+{
+    const u64 *input = _input;
+    u64 a, b, c, d, e, f, g, h, t1, t2;
+    u64 W[16];
+    unsigned int i;
+
+    /* load the input */
+    for ( i = 0; i < 16; i++ )
+        W[i] = be64_to_cpu(input[i]);
+
+    /* load the state into our registers */
+    a = state[0];  b = state[1];  c = state[2];  d = state[3];
+    e = state[4];  f = state[5];  g = state[6];  h = state[7];
+
+    /* now iterate */
+    for ( i = 0; i < 80; i++ )
+    {
+        t1 = h + e1(e) + Ch(e, f, g) + K[i] +
+             (i < 16 ? W[i] : sha512_blend(W, i));
+        t2 = e0(a) + Maj(a, b, c);
+
+        h = g;  g = f;  f = e;  e = d + t1;
+        d = c;  c = b;  b = a;  a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static const u64 sha384_iv[] = {
+    0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL,
+    0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+    0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL,
+    0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL,
+};
+
+static const u64 sha512_iv[] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+/* 64 bit immediates are big, so copy the initial values from a table */
+static void sha512_start(struct sha512_state *sctx, const u64 *iv)
+{
+    memcpy(sctx->state, iv, sizeof(sctx->state));
+    sctx->count = 0;
+}
+
+void sha384_init(struct sha512_state *sctx)
+{
+    sha512_start(sctx, sha384_iv);
+}
+
+void sha512_init(struct sha512_state *sctx)
+{
+    sha512_start(sctx, sha512_iv);
+}
+
+void sha512_update(struct sha512_state *sctx, const void *data, size_t len)
+{
+    unsigned int partial = sctx->count & 0x7f;
+
+    sctx->count += len;
+
+    /* Top up a block left over from the previous call first */
+    if ( partial )
+    {
+        unsigned int fill = SHA512_BLOCK_SIZE - partial;
+
+        if ( len < fill )
+        {
+            memcpy(sctx->buf + partial, data, len);
+            return;
+        }
+
+        memcpy(sctx->buf + partial, data, fill);
+        sha512_transform(sctx->state, sctx->buf);
+        data += fill;
+        len -= fill;
+    }
+
+    for ( ; len >= SHA512_BLOCK_SIZE; data += SHA512_BLOCK_SIZE,
+                                      len -= SHA512_BLOCK_SIZE )
+        sha512_transform(sctx->state, data);
+
+    memcpy(sctx->buf, data, len);
+}
+
+/* Pad, and store the first @words words of the state in @dst */
+static void sha512_pad(struct sha512_state *sctx, u64 *dst, unsigned int words)
+{
+    u64 *count;
+    unsigned int i, partial = sctx->count & 0x7f;
+
+    /* Start padding */
+    sctx->buf[partial++] = 0x80;
+
+    if ( partial > 112 )
+    {
+        /* Need one extra block - pad to 128 */
+        memset(sctx->buf + partial, 0, 128 - partial);
+        sha512_transform(sctx->state, sctx->buf);
+        partial = 0;
+    }
+    /* Pad to 120, leaving the top half of the 128 bit count as zero */
+    memset(sctx->buf + partial, 0, 120 - partial);
+
+    /* Append the 64 bit count */
+    count = (void *)&sctx->buf[120];
+    *count = cpu_to_be64(sctx->count << 3);
+    sha512_transform(sctx->state, sctx->buf);
+
+    /* Store state in digest */
+    for ( i = 0; i < words; i++ )
+        dst[i] = cpu_to_be64(sctx->state[i]);
+}
+
+void sha384_final(struct sha512_state *sctx, void *dst)
+{
+    sha512_pad(sctx, dst, SHA384_DIGEST_SIZE / 8);
+}
+
+void sha512_final(struct sha512_state *sctx, void *dst)
+{
+    sha512_pad(sctx, dst, SHA512_DIGEST_SIZE / 8);
+}
+
+void sha384sum(u8 hash[static SHA384_DIGEST_SIZE], const void *data, u32 len)
+{
+    struct sha512_state sctx;
+
+    sha384_init(&sctx);
+    sha512_update(&sctx, data, len);
+    sha384_final(&sctx, hash);
+}
+
+void sha512sum(u8 hash[static SHA512_DIGEST_SIZE], const void *data, u32 len)
+{
+    struct sha512_state sctx;
+
+    sha512_init(&sctx);
+    sha512_update(&sctx, data, len);
+    sha512_final(&sctx, hash);
+}
@@ -0,0 +1,184 @@
+/*
+ * SM3-256, as specified in GB/T 32905-2016 and
+ * https://datatracker.ietf.org/doc/html/draft-sca-cfrg-sm3-02
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <byteswap.h>
+#include <types.h>
+#include <sm3.h>
+#include <string.h>
+
+/* Safe for a shift of 0, which the round constant rotation needs */
+static inline u32 rol32(u32 word, unsigned int shift)
+{
+    return (word << shift) | (word >> (-shift & 31));
+}
+
+#define P0(x)       ((x) ^ rol32(x, 9) ^ rol32(x, 17))
+#define P1(x)       ((x) ^ rol32(x, 15) ^ rol32(x, 23))
+
+/*
+ * Compute W[i + 4] of the message expansion, in a 16 word window.  Rounds
+ * need both W[i] and W'[i] = W[i] ^ W[i + 4], so the window runs 4 words
+ * ahead of the round, and W[i + 4] takes the slot of W[i - 12] which is
+ * consumed here for the last time.
+ */
+static void sm3_expand(u32 *W, unsigned int i)
+{
+#define W(i) W[(i) & 15]
+
+    W(i + 4) = P1(W(i - 12) ^ W(i - 5) ^ rol32(W(i + 1), 15)) ^
+               rol32(W(i - 9), 7) ^ W(i - 2);
+
+#undef W
+}
+
+/*
+ * One round per iteration, to keep the size down.  The two halves of the
+ * rounds differ only in the boolean functions and the constant.
+ */
+static void sm3_transform(u32 *state, const void *_input)
+{
+    const u32 *input = _input;
+    u32 a, b, c, d, e, f, g, h, ss1, ss2, tt1, tt2;
+    u32 W[16];
+    unsigned int i;
+
+    /* load the input */
+    for ( i = 0; i < 16; i++ )
+        W[i] = be32_to_cpu(input[i]);
+
+    /* load the state into our registers */
+    a = state[0];  b = state[1];  c = state[2];  d = state[3];
+    e = state[4];  f = state[5];  g = state[6];  h = state[7];
+
+    /* now iterate */
+    for ( i = 0; i < 64; i++ )
+    {
+        if ( i >= 12 )
+            sm3_expand(W, i);
+
+        ss1 = rol32(rol32(a, 12) + e +
+                    rol32(i < 16 ? 0x79cc4519 : 0x7a879d8a, i & 31), 7);
+        ss2 = ss1 ^ rol32(a, 12);
+
+        if ( i < 16 )
+        {
+            tt1 = (a ^ b ^ c);
+            tt2 = (e ^ f ^ g);
+        }
+        else
+        {
+            tt1 = (a & b) | (c & (a | b));
+            tt2 = g ^ (e & (f ^ g));
+        }
+
+        tt1 += d + ss2 + (W[i & 15] ^ W[(i + 4) & 15]);
+        tt2 += h + ss1 + W[i & 15];
+
+        d = c;  c = rol32(b, 9);   b = a;  a = tt1;
+        h = g;  g = rol32(f, 19);  f = e;  e = P0(tt2);
+    }
+
+    state[0] ^= a; state[1] ^= b; state[2] ^= c; state[3] ^= d;
+    state[4] ^= e; state[5] ^= f; state[6] ^= g; state[7] ^= h;
+}
+
+void sm3_init(struct sm3_state *sctx)
+{
+    *sctx = (struct sm3_state){
+        .state = {
+            0x7380166fUL,
+            0x4914b2b9UL,
+            0x172442d7UL,
+            0xda8a0600UL,
+            0xa96f30bcUL,
+            0x163138aaUL,
+            0xe38dee4dUL,
+            0xb0fb0e4eUL,
+        },
+    };
+}
+
+void sm3_update(struct sm3_state *sctx, const void *data, size_t len)
+{
+    unsigned int partial = sctx->count & 0x3f;
+
+    sctx->count += len;
+
+    /* Top up a block left over from the previous call first */
+    if ( partial )
+    {
+        unsigned int fill = SM3_BLOCK_SIZE - partial;
+
+        if ( len < fill )
+        {
+            memcpy(sctx->buf + partial, data, len);
+            return;
+        }
+
+        memcpy(sctx->buf + partial, data, fill);
+        sm3_transform(sctx->state, sctx->buf);
+        data += fill;
+        len -= fill;
+    }
+
+    for ( ; len >= SM3_BLOCK_SIZE; data += SM3_BLOCK_SIZE,
+                                   len -= SM3_BLOCK_SIZE )
+        sm3_transform(sctx->state, data);
+
+    memcpy(sctx->buf, data, len);
+}
+
+/* The padding is the same as for SHA-256 */
+void sm3_final(struct sm3_state *sctx, void *_dst)
+{
+    u32 *dst = _dst;
+    u64 *count;
+    unsigned int i, partial = sctx->count & 0x3f;
+
+    /* Start padding */
+    sctx->buf[partial++] = 0x80;
+
+    if ( partial > 56 )
+    {
+        /* Need one extra block - pad to 64 */
+        memset(sctx->buf + partial, 0, 64 - partial);
+        sm3_transform(sctx->state, sctx->buf);
+        partial = 0;
+    }
+    /* Pad to 56 */
+    memset(sctx->buf + partial, 0, 56 - partial);
+
+    /* Append the 64 bit count */
+    count = (void *)&sctx->buf[56];
+    *count = cpu_to_be64(sctx->count << 3);
+    sm3_transform(sctx->state, sctx->buf);
+
+    /* Store state in digest */
+    for ( i = 0; i < 8; i++ )
+        dst[i] = cpu_to_be32(sctx->state[i]);
+}
+
+void sm3sum(u8 hash[static SM3_DIGEST_SIZE], const void *data, u32 len)
+{
+    struct sm3_state sctx;
+
+    sm3_init(&sctx);
+    sm3_update(&sctx, data, len);
+    sm3_final(&sctx, hash);
+}
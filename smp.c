@@ -0,0 +1,224 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * SKINIT leaves the APs in INIT.  With SMP=y and an SKL_TAG_SMP region, wake
+ * a few of them to share the hashing.  The APs run from SKL itself; only the
+ * real mode trampoline (which SIPI requires below 1M) and their stacks live
+ * in the region.  The BSP keeps doing all TPM work, in the original order.
+ */
+
+#include <defs.h>
+#include <types.h>
+#include <boot.h>
+#include <hash.h>
+#include <smp.h>
+#include <string.h>
+#include <tags.h>
+#include <printk.h>
+#include "tpmlib/tpm_common.h"
+
+/* From head.S */
+struct ap_boot {
+    u16 gdt_limit;              /* lgdt operand */
+    u32 gdt_base;
+    u32 entry;                  /* ljmp operand, with CS_SEL32 */
+    u16 cs;
+    u32 skl_base;               /* %ebp for ap_entry */
+} __packed;
+
+extern const char ap_trampoline[], ap_trampoline_end[], ap_entry[];
+extern struct ap_boot ap_boot;
+
+/* Shared with ap_entry */
+u32 ap_max;                     /* APs allowed past ap_entry */
+u32 ap_stacks;                  /* Base of the first AP stack */
+volatile u32 ap_count;          /* APs which reached ap_entry */
+volatile u32 ap_parked;         /* APs back in ap_entry, about to halt */
+
+static struct hash_job *volatile jobs;
+static volatile u32 nr_jobs, next_job, jobs_done;
+static volatile bool stopping;
+static bool woken;              /* SIPIs sent, so the APs need an INIT */
+
+static void *apic;
+
+static void send_ipi(u32 icr)
+{
+    if ( !apic )
+    {
+        wrmsr(MSR_X2APIC_ICR, icr);
+        return;
+    }
+
+    iowrite32(0, apic + APIC_ICR_HI);
+    iowrite32(icr, apic + APIC_ICR_LO);
+    while ( ioread32(apic + APIC_ICR_LO) & APIC_ICR_BUSY )
+        cpu_relax();
+}
+
+/* Run the next job, if there is one. */
+static bool run_job(void)
+{
+    u32 i = next_job;
+    struct hash_job *j;
+
+    if ( i >= nr_jobs || !__sync_bool_compare_and_swap(&next_job, i, i + 1) )
+        return false;
+
+    j = &jobs[i];
+    if ( j->sha1 && j->sha256 )
+        sha1sha256sum(j->sha1, j->sha256, j->data, j->size);
+    else if ( j->sha1 )
+        sha1sum(j->sha1, j->data, j->size);
+    else
+        sha256sum(j->sha256, j->data, j->size);
+
+    __sync_fetch_and_add(&jobs_done, 1);
+
+    return true;
+}
+
+/* Called by ap_entry on the AP's own stack, in the same mode as skl_main() */
+void ap_main(void)
+{
+    while ( !stopping )
+        if ( !run_job() )
+            cpu_relax();
+}
+
+void smp_hash(struct hash_job *j, unsigned int n)
+{
+    /* APs only look at the jobs once nr_jobs says they are there. */
+    jobs = j;
+    next_job = 0;
+    jobs_done = 0;
+    barrier();
+    nr_jobs = n;
+
+    while ( run_job() )
+        ;
+
+    while ( jobs_done != n )
+        cpu_relax();
+
+    nr_jobs = 0;
+    barrier();
+}
+
+bool smp_active(void)
+{
+    /* ap_max is only what the region has stacks for */
+    return ap_max && ap_count;
+}
+
+void smp_start(void)
+{
+    struct skl_tag_smp *t = next_of_type(&bootloader_data, SKL_TAG_SMP);
+    struct __packed {
+        u16 limit;
+        unsigned long base;
+    } gdtr;
+    struct ap_boot *b;
+    u64 apic_base;
+    void *region;
+
+    if ( t == NULL )
+        return;
+
+    region = _p(t->address);
+
+    /*
+     * The trampoline must be addressable by SIPI, and the region must not
+     * overlap SKL, nor the other regions it writes, nor wrap.  The kernel,
+     * MBI and modules are checked against it as they are measured.
+     */
+    if ( t->hdr.len != sizeof(*t)
+         || t->address & ~PAGE_MASK
+         || t->address >= 0x100000
+         || t->size < 2 * PAGE_SIZE
+         || t->address + t->size < t->address
+         || (region < _p(_start + SLB_SIZE) && region + t->size > _p(_start))
+         || overlaps_skl_region(t->address, t->size, t) )
+    {
+        print("Bad SMP region, not starting APs\n");
+        return;
+    }
+
+    apic_base = rdmsr(MSR_APIC_BASE);
+    if ( !(apic_base & APIC_BASE_EN) )
+    {
+        print("Local APIC disabled, not starting APs\n");
+        return;
+    }
+    apic = (apic_base & APIC_BASE_EXTD) ? NULL
+                                        : _p(apic_base & APIC_BASE_ADDR_MASK);
+
+    memcpy(region, ap_trampoline, ap_trampoline_end - ap_trampoline);
+
+    asm volatile ("sgdt %0" : "=m" (gdtr));
+    b = region + (_u(&ap_boot) - _u(ap_trampoline));
+    b->gdt_limit = gdtr.limit;
+    b->gdt_base = gdtr.base;
+    b->entry = _u(ap_entry);
+    b->skl_base = _u(_start);
+
+    ap_stacks = t->address + PAGE_SIZE;
+    ap_max = t->size / PAGE_SIZE - 1;
+    if ( ap_max > SMP_MAX_APS )
+        ap_max = SMP_MAX_APS;
+
+    /*
+     * Every AP gets woken, but only the first ap_max to arrive take a stack.
+     * The rest halt straight away.
+     */
+    woken = true;
+    send_ipi(APIC_DEST_ALLBUT | APIC_INT_ASSERT | APIC_DM_INIT);
+    tpm_mdelay(10);
+    send_ipi(APIC_DEST_ALLBUT | APIC_DM_STARTUP | PAGE_PFN(region));
+    tpm_udelay(200);
+    send_ipi(APIC_DEST_ALLBUT | APIC_DM_STARTUP | PAGE_PFN(region));
+    tpm_udelay(200);
+
+    print("APs started: ");
+    print_u64(ap_count);
+    print("\n");
+}
+
+void smp_stop(void)
+{
+    u64 deadline;
+
+    /*
+     * Not smp_active(): an AP which hasn't checked in yet may still be on its
+     * way through the trampoline, and needs the INIT all the same.
+     */
+    if ( !woken )
+        return;
+
+    /* Let the APs scrub their vector state before INIT, if they can. */
+    stopping = true;
+    deadline = tpm_deadline(100000);
+    while ( ap_parked < (ap_count < ap_max ? ap_count : ap_max)
+            && !tpm_expired(deadline) )
+        cpu_relax();
+
+    send_ipi(APIC_DEST_ALLBUT | APIC_INT_ASSERT | APIC_DM_INIT);
+    tpm_mdelay(10);
+
+    ap_max = 0;
+    woken = false;
+}
@@ -48,6 +48,18 @@ static const struct test {
         "                                                                      ", /* 70 */
         HASH(6f2a4b80, 7e4fd5ac, cdae059f, 9ec553b1, a6872a27),
     },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 112 */
+        HASH(a49b2446, a02c645b, f419f995, b6709125, 3a04a259),
+    },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 224, several blocks */
+        HASH(0c35f042, b13ba2aa, b1f6f01c, 63805409, 017f411a),
+    },
 };
 
 static void dump_hash(const u32 *hash)
@@ -56,32 +68,96 @@ static void dump_hash(const u32 *hash)
         printf("%08"PRIx32, cpu_to_be32(hash[j]));
 }
 
+/*
+ * Either hash in one go, or feed the message in pieces of 1, 3, 7, ... bytes
+ * to exercise the partial block handling of the incremental interface.
+ */
+static void hash_msg(void *hash, const char *msg, bool split)
+{
+    size_t len = strlen(msg), off, step;
+    struct sha1_state ctx;
+
+    if ( !split )
+    {
+        sha1sum(hash, msg, len);
+        return;
+    }
+
+    sha1_init(&ctx);
+    for ( off = 0, step = 1; off < len; off += step, step = step * 2 + 1 )
+        sha1_update(&ctx, msg + off, step < len - off ? step : len - off);
+    sha1_final(&ctx, hash);
+}
+
 int main(void)
 {
     bool fail = false;
 
-    for ( unsigned int i = 0; i < ARRAY_SIZE(tests); ++i )
+    /*
+     * With whatever the host supports, with SSSE3 rather than SHA-NI, and with
+     * the generic code, each both in one go and incrementally.
+     */
+    for ( unsigned int pass = 0; pass < 6; ++pass )
     {
-        const struct test *t = &tests[i];
-        u32 hash[SHA1_DIGEST_SIZE];
+        sha_ni_disabled = (pass >> 1) == 1;
+        simd_disabled = (pass >> 1) == 2;
+
+        for ( unsigned int i = 0; i < ARRAY_SIZE(tests); ++i )
+        {
+            const struct test *t = &tests[i];
+            u32 hash[SHA1_DIGEST_SIZE];
+
+            hash_msg(hash, t->msg, pass & 1);
+
+            if ( memcmp(hash, t->hash, sizeof(hash)) == 0 )
+                continue;
 
-        sha1sum((void *)hash, t->msg, strlen(t->msg));
+            fail = true;
+            printf("Fail: Message '%s'\n"
+                   "  Got:      ",
+                   t->msg);
 
-        if ( memcmp(hash, t->hash, sizeof(hash)) == 0 )
-            continue;
+            dump_hash(hash);
 
-        fail = true;
-        printf("Fail: Message '%s'\n"
-               "  Got:      ",
-               t->msg);
+            printf("\n"
+                   "  Expected: ");
+
+            dump_hash(t->hash);
+            printf("\n");
+        }
+    }
+
+    /*
+     * Past 512 MiB the length in bits no longer fits in 32, so all 64 must
+     * make it into the final block.  The message is zeroes, fed a MiB at a
+     * time.
+     */
+    {
+        static const u8 zeroes[1024 * 1024];
+        static const u32 want[SHA1_DIGEST_SIZE] = HASH(b28134b0, 42220c2b, 14020c38, 5afce203, 77858cf2);
+        struct sha1_state ctx;
+        u32 hash[SHA1_DIGEST_SIZE];
 
-        dump_hash(hash);
+        sha_ni_disabled = false;
+        simd_disabled = false;
 
-        printf("\n"
-               "  Expected: ");
+        sha1_init(&ctx);
+        for ( unsigned int i = 0; i < 512; ++i )
+            sha1_update(&ctx, zeroes, sizeof(zeroes));
+        sha1_update(&ctx, zeroes, 3);
+        sha1_final(&ctx, (void *)hash);
 
-        dump_hash(t->hash);
-        printf("\n");
+        if ( memcmp(hash, want, sizeof(hash)) )
+        {
+            fail = true;
+            printf("Fail: 512 MiB + 3 zeroes\n"
+                   "  Got:      ");
+            dump_hash(hash);
+            printf("\n"
+                   "  Expected: ");
+            dump_hash(want);
+            printf("\n");
+        }
     }
 
     if ( !fail )
@@ -0,0 +1,74 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "sha1sum.c"
+#include "sha256.c"
+#include "hash.c"
+
+/*
+ * sha1sha256sum() must be indistinguishable from calling sha1sum() and
+ * sha256sum() separately.  Check every length across several block
+ * boundaries, including the ones where padding spills into an extra block,
+ * against the generic transforms.
+ */
+#define MAX_LEN 600
+
+static void dump_hash(const u8 *hash, size_t len)
+{
+    for ( unsigned int j = 0; j < len; ++j )
+        printf("%02x", hash[j]);
+}
+
+int main(void)
+{
+    static u8 msg[MAX_LEN];
+    bool fail = false;
+
+    for ( unsigned int i = 0; i < MAX_LEN; ++i )
+        msg[i] = i * 7 + 3;
+
+    for ( unsigned int len = 0; len <= MAX_LEN; ++len )
+    {
+        u8 sha1[SHA1_DIGEST_SIZE], sha1_ref[SHA1_DIGEST_SIZE];
+        u8 sha256[32], sha256_ref[32];
+
+        simd_disabled = true;
+        sha1sum(sha1_ref, msg, len);
+        sha256sum(sha256_ref, msg, len);
+        simd_disabled = false;
+
+        /* With SHA-NI if the host has it, then with SSSE3 */
+        for ( unsigned int pass = 0; pass < 2; ++pass )
+        {
+            sha_ni_disabled = pass;
+            sha1sha256sum(sha1, sha256, msg, len);
+
+            if ( memcmp(sha1, sha1_ref, sizeof(sha1)) == 0 &&
+                 memcmp(sha256, sha256_ref, sizeof(sha256)) == 0 )
+                continue;
+
+            fail = true;
+            printf("Fail: Length %u, pass %u\n"
+                   "  Got:      ", len, pass);
+
+            dump_hash(sha1, sizeof(sha1));
+            printf(" ");
+            dump_hash(sha256, sizeof(sha256));
+
+            printf("\n"
+                   "  Expected: ");
+
+            dump_hash(sha1_ref, sizeof(sha1_ref));
+            printf(" ");
+            dump_hash(sha256_ref, sizeof(sha256_ref));
+            printf("\n");
+        }
+    }
+
+    if ( !fail )
+        printf("All ok\n");
+
+    return fail;
+}
@@ -48,6 +48,18 @@ static const struct test {
         "                                                                      ", /* 70 */
         HASH(f5d88515972d5d9b, df69f17f5cfde6d0, 33357f359c155efb, df18ca64a6dd6335),
     },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 112 */
+        HASH(cf5b16a778af8380, 036ce59e7b049237, 0b249b11e8f07a51, afac45037afee9d1),
+    },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 224, several blocks */
+        HASH(cdbf867f784a69c7, d2e252baa9075c37, 62843b1beb52c04d, 4be39e7777d95717),
+    },
 };
 
 static void dump_hash(const u64 *hash)
@@ -56,32 +68,178 @@ static void dump_hash(const u64 *hash)
         printf("%016"PRIx64, cpu_to_be64(hash[j]));
 }
 
+/*
+ * Either hash in one go, or feed the message in pieces of 1, 3, 7, ... bytes
+ * to exercise the partial block handling of the incremental interface.
+ */
+static void hash_msg(void *hash, const char *msg, bool split)
+{
+    size_t len = strlen(msg), off, step;
+    struct sha256_state ctx;
+
+    if ( !split )
+    {
+        sha256sum(hash, msg, len);
+        return;
+    }
+
+    sha256_init(&ctx);
+    for ( off = 0, step = 1; off < len; off += step, step = step * 2 + 1 )
+        sha256_update(&ctx, msg + off, step < len - off ? step : len - off);
+    sha256_final(&ctx, hash);
+}
+
 int main(void)
 {
     bool fail = false;
 
-    for ( unsigned int i = 0; i < ARRAY_SIZE(tests); ++i )
+    /*
+     * With whatever the host supports, with SSSE3 rather than SHA-NI, and with
+     * the generic code, each both in one go and incrementally.
+     */
+    for ( unsigned int pass = 0; pass < 6; ++pass )
     {
-        const struct test *t = &tests[i];
-        u64 hash[SHA256_DIGEST_SIZE];
+        sha_ni_disabled = (pass >> 1) == 1;
+        simd_disabled = (pass >> 1) == 2;
+
+        for ( unsigned int i = 0; i < ARRAY_SIZE(tests); ++i )
+        {
+            const struct test *t = &tests[i];
+            u64 hash[SHA256_DIGEST_SIZE];
+
+            hash_msg(hash, t->msg, pass & 1);
+
+            if ( memcmp(hash, t->hash, sizeof(hash)) == 0 )
+                continue;
+
+            fail = true;
+            printf("Fail: Message '%s'\n"
+                   "  Got:      ",
+                   t->msg);
 
-        sha256sum((void *)hash, t->msg, strlen(t->msg));
+            dump_hash(hash);
+
+            printf("\n"
+                   "  Expected: ");
+
+            dump_hash(t->hash);
+            printf("\n");
+        }
+    }
+
+    /*
+     * Multi-buffer, with more buffers than lanes and of many lengths so lanes
+     * finish and get refilled at different times.  Without SHA-NI so the
+     * lanes are really used, and with the generic fallback.
+     */
+    for ( unsigned int pass = 0; pass < 2; ++pass )
+    {
+        const void *data[ARRAY_SIZE(tests)];
+        u32 len[ARRAY_SIZE(tests)];
+        u64 hash[ARRAY_SIZE(tests)][SHA256_DIGEST_SIZE];
 
-        if ( memcmp(hash, t->hash, sizeof(hash)) == 0 )
-            continue;
+        sha_ni_disabled = true;
+        simd_disabled = pass;
 
-        fail = true;
-        printf("Fail: Message '%s'\n"
-               "  Got:      ",
-               t->msg);
+        for ( unsigned int i = 0; i < ARRAY_SIZE(tests); ++i )
+        {
+            data[i] = tests[i].msg;
+            len[i] = strlen(tests[i].msg);
+        }
+
+        sha256sum_mb((void *)hash, data, len, ARRAY_SIZE(tests));
+
+        for ( unsigned int i = 0; i < ARRAY_SIZE(tests); ++i )
+        {
+            const struct test *t = &tests[i];
+
+            if ( memcmp(hash[i], t->hash, sizeof(hash[i])) == 0 )
+                continue;
+
+            fail = true;
+            printf("Fail: Multi-buffer message '%s'\n"
+                   "  Got:      ",
+                   t->msg);
+
+            dump_hash(hash[i]);
+
+            printf("\n"
+                   "  Expected: ");
+
+            dump_hash(t->hash);
+            printf("\n");
+        }
+    }
+
+    /* Also against sha256sum(), for lanes running many blocks at once */
+    {
+        static u8 msg[4096];
+        const void *data[16];
+        u32 len[16];
+        u64 hash[16][SHA256_DIGEST_SIZE], ref[SHA256_DIGEST_SIZE];
+
+        for ( unsigned int i = 0; i < sizeof(msg); ++i )
+            msg[i] = i * 7 + 3;
+
+        for ( unsigned int i = 0; i < ARRAY_SIZE(data); ++i )
+        {
+            data[i] = msg + i;
+            len[i] = (i * 1237) % (sizeof(msg) - i);
+        }
+
+        sha_ni_disabled = true;
+        simd_disabled = false;
+        sha256sum_mb((void *)hash, data, len, ARRAY_SIZE(data));
+
+        for ( unsigned int i = 0; i < ARRAY_SIZE(data); ++i )
+        {
+            sha256sum((void *)ref, data[i], len[i]);
+
+            if ( memcmp(hash[i], ref, sizeof(ref)) == 0 )
+                continue;
+
+            fail = true;
+            printf("Fail: Multi-buffer length %u\n"
+                   "  Got:      ", len[i]);
+            dump_hash(hash[i]);
+            printf("\n"
+                   "  Expected: ");
+            dump_hash(ref);
+            printf("\n");
+        }
+    }
+
+    /*
+     * Past 512 MiB the length in bits no longer fits in 32, so all 64 must
+     * make it into the final block.  The message is zeroes, fed a MiB at a
+     * time.
+     */
+    {
+        static const u8 zeroes[1024 * 1024];
+        static const u64 want[SHA256_DIGEST_SIZE] = HASH(403a955183d83bd3, 7bd31dde74eb3b71, 3fcf99b6ba1a87fa, 91aa5befe4f51280);
+        struct sha256_state ctx;
+        u64 hash[SHA256_DIGEST_SIZE];
 
-        dump_hash(hash);
+        sha_ni_disabled = false;
+        simd_disabled = false;
 
-        printf("\n"
-               "  Expected: ");
+        sha256_init(&ctx);
+        for ( unsigned int i = 0; i < 512; ++i )
+            sha256_update(&ctx, zeroes, sizeof(zeroes));
+        sha256_update(&ctx, zeroes, 3);
+        sha256_final(&ctx, hash);
 
-        dump_hash(t->hash);
-        printf("\n");
+        if ( memcmp(hash, want, sizeof(hash)) )
+        {
+            fail = true;
+            printf("Fail: 512 MiB + 3 zeroes\n"
+                   "  Got:      ");
+            dump_hash(hash);
+            printf("\n"
+                   "  Expected: ");
+            dump_hash(want);
+            printf("\n");
+        }
     }
 
     if ( !fail )
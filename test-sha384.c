@@ -0,0 +1,145 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "sha512.c"
+
+/* Deal with everything in terms of u64 rather than u8 */
+#undef SHA384_DIGEST_SIZE
+#define SHA384_DIGEST_SIZE (48 / 8)
+
+#define HASH(a, b, c, d, e, f) { _(a), _(b), _(c), _(d), _(e), _(f) }
+#define _(x) cpu_to_be64(0x ## x ## ULL)
+
+static const struct test {
+    const char *msg;
+    u64 hash[SHA384_DIGEST_SIZE];
+} tests[] = {
+    {
+        "",
+        HASH(38b060a751ac9638, 4cd9327eb1b1e36a, 21fdb71114be0743,
+             4c0cc7bf63f6e1da, 274edebfe76f65fb, d51ad2f14898b95b),
+    },
+    {
+        "a",
+        HASH(54a59b9f22b0b808, 80d8427e548b7c23, abd873486e1f035d,
+             ce9cd697e8517503, 3caa88e6d57bc35e, fae0b5afd3145f31),
+    },
+    {
+        "abc",
+        HASH(cb00753f45a35e8b, b5a03d699ac65007, 272c32ab0eded163,
+             1a8b605a43ff5bed, 8086072ba1e7cc23, 58baeca134c825a7),
+    },
+    {
+        "The quick brown fox jumps over the lazy dog",
+        HASH(ca737f1014a48f4c, 0b6dd43cb177b0af, d9e5169367544c49,
+             4011e3317dbf9a50, 9cb1e5dc1e85a941, bbee3d7f2afbc9b1),
+    },
+    {
+        "                                                        "
+        "                                                      ", /* 110 */
+        HASH(54ef8c3c0b07d33b, 181427a95bf4d355, a20967b6b43743c8,
+             0ba8c0f7e4bbd744, 3d62b71092ea3479, 8a0a55b54f987fec),
+    },
+    {
+        "                                                        "
+        "                                                       ", /* 111 */
+        HASH(59b1db7b5560e39c, fffa31891eda9535, d59cca9d250dc72f,
+             046d28a3ce4f8247, 772eb7b417667379, 7a52dff01b0e1e74),
+    },
+    {
+        "                                                        "
+        "                                                        ", /* 112 */
+        HASH(eeeb32d2adae0a78, ff0d042cb2517069, 3f829ef360dcbc47,
+             a91b7b209348c8a8, 87e93d8adccfb1e5, 7c0694fd631621bb),
+    },
+    {
+        "                                                        "
+        "                                                        "
+        "        ", /* 120 */
+        HASH(f05ee7a61570de87, a575867999b088d4, cf2148d801e89725,
+             87e2bf476ff3355b, b39049f9c6b34551, d3bb86c7c5369694),
+    },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 112 */
+        HASH(09330c33f71147e8, 3d192fc782cd1b47, 53111b173b3b05d2,
+             2fa08086e3b0f712, fcc7c71a557e2db9, 66c3e9fa91746039),
+    },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 336, several blocks */
+        HASH(9b2937f85162d98c, 0bc50ec140b8d7e5, 963b16dbb38c9e4e,
+             57c891251d150dcf, 9f2e3ba9768831d9, 304bedaa5184e719),
+    },
+};
+
+static void dump_hash(const u64 *hash)
+{
+    for ( unsigned int j = 0; j < SHA384_DIGEST_SIZE; ++j )
+        printf("%016"PRIx64, cpu_to_be64(hash[j]));
+}
+
+/*
+ * Either hash in one go, or feed the message in pieces of 1, 3, 7, ... bytes
+ * to exercise the partial block handling of the incremental interface.
+ */
+static void hash_msg(void *hash, const char *msg, bool split)
+{
+    size_t len = strlen(msg), off, step;
+    struct sha512_state ctx;
+
+    if ( !split )
+    {
+        sha384sum(hash, msg, len);
+        return;
+    }
+
+    sha384_init(&ctx);
+    for ( off = 0, step = 1; off < len; off += step, step = step * 2 + 1 )
+        sha512_update(&ctx, msg + off, step < len - off ? step : len - off);
+    sha384_final(&ctx, hash);
+}
+
+int main(void)
+{
+    bool fail = false;
+
+    /* Both in one go and incrementally */
+    for ( unsigned int pass = 0; pass < 2; ++pass )
+    {
+        for ( unsigned int i = 0; i < ARRAY_SIZE(tests); ++i )
+        {
+            const struct test *t = &tests[i];
+            u64 hash[SHA384_DIGEST_SIZE];
+
+            hash_msg(hash, t->msg, pass);
+
+            if ( memcmp(hash, t->hash, sizeof(hash)) == 0 )
+                continue;
+
+            fail = true;
+            printf("Fail: Message '%s'\n"
+                   "  Got:      ",
+                   t->msg);
+
+            dump_hash(hash);
+
+            printf("\n"
+                   "  Expected: ");
+
+            dump_hash(t->hash);
+            printf("\n");
+        }
+    }
+
+    if ( !fail )
+        printf("All ok\n");
+
+    return fail;
+}
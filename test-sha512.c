@@ -0,0 +1,145 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "sha512.c"
+
+/* Deal with everything in terms of u64 rather than u8 */
+#undef SHA512_DIGEST_SIZE
+#define SHA512_DIGEST_SIZE (64 / 8)
+
+#define HASH(a, b, c, d, e, f, g, h) { _(a), _(b), _(c), _(d), _(e), _(f), _(g), _(h) }
+#define _(x) cpu_to_be64(0x ## x ## ULL)
+
+static const struct test {
+    const char *msg;
+    u64 hash[SHA512_DIGEST_SIZE];
+} tests[] = {
+    {
+        "",
+        HASH(cf83e1357eefb8bd, f1542850d66d8007, d620e4050b5715dc, 83f4a921d36ce9ce,
+             47d0d13c5d85f2b0, ff8318d2877eec2f, 63b931bd47417a81, a538327af927da3e),
+    },
+    {
+        "a",
+        HASH(1f40fc92da241694, 750979ee6cf582f2, d5d7d28e18335de0, 5abc54d0560e0f53,
+             02860c652bf08d56, 0252aa5e74210546, f369fbbbce8c12cf, c7957b2652fe9a75),
+    },
+    {
+        "abc",
+        HASH(ddaf35a193617aba, cc417349ae204131, 12e6fa4e89a97ea2, 0a9eeee64b55d39a,
+             2192992a274fc1a8, 36ba3c23a3feebbd, 454d4423643ce80e, 2a9ac94fa54ca49f),
+    },
+    {
+        "The quick brown fox jumps over the lazy dog",
+        HASH(07e547d9586f6a73, f73fbac0435ed769, 51218fb7d0c8d788, a309d785436bbb64,
+             2e93a252a954f239, 12547d1e8a3b5ed6, e1bfd7097821233f, a0538f3db854fee6),
+    },
+    {
+        "                                                        "
+        "                                                      ", /* 110 */
+        HASH(6b5e8d632a1af786, 692ee9312c92b0ef, 5c918b4e2f11c0c5, 6c1ab108da761da0,
+             8d23384424d0fbc9, 1fcff1872829f025, d24cc9fa7605cc98, e3f53f56e5ba9601),
+    },
+    {
+        "                                                        "
+        "                                                       ", /* 111 */
+        HASH(088aeed6d695694b, 35fea27823efeae8, d7469fbc3b639c9d, 5ab6e960e1c55593,
+             b7f37353397fb8cf, 5af17c89c86e8bb2, 591a45ed17d5c65c, baab56ff6b6c8a5c),
+    },
+    {
+        "                                                        "
+        "                                                        ", /* 112 */
+        HASH(2903ee1a8fa87baf, 1815cd1ed72dd67e, 369ab49c12bca5cf, 643bbeaa83361d1b,
+             cb4eaf36a91e74c8, 07f734bdbfac2736, 97a31a162b66f172, faecebd5f6e262fe),
+    },
+    {
+        "                                                        "
+        "                                                        "
+        "        ", /* 120 */
+        HASH(139af877fbf02d97, 340f897da42805c9, c65e906ca2db38c9, ded753d3c0e04156,
+             bee982aff569def6, cc64f2d8497d05af, 7231eafd2a91d363, 53f69fb7bbe20a9d),
+    },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 112 */
+        HASH(8e959b75dae313da, 8cf4f72814fc143f, 8f7779c6eb9f7fa1, 7299aeadb6889018,
+             501d289e4900f7e4, 331b99dec4b5433a, c7d329eeb6dd2654, 5e96e55b874be909),
+    },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 336, several blocks */
+        HASH(6e59d86c93e5aee5, e08c8d6ca7b84f8f, 47fec3fce309d18e, 50acd71bfac85703,
+             8ccea47330191965, f3ec37eaa5e45f67, 356f3c32475bb152, 5b12a43dc24036b9),
+    },
+};
+
+static void dump_hash(const u64 *hash)
+{
+    for ( unsigned int j = 0; j < SHA512_DIGEST_SIZE; ++j )
+        printf("%016"PRIx64, cpu_to_be64(hash[j]));
+}
+
+/*
+ * Either hash in one go, or feed the message in pieces of 1, 3, 7, ... bytes
+ * to exercise the partial block handling of the incremental interface.
+ */
+static void hash_msg(void *hash, const char *msg, bool split)
+{
+    size_t len = strlen(msg), off, step;
+    struct sha512_state ctx;
+
+    if ( !split )
+    {
+        sha512sum(hash, msg, len);
+        return;
+    }
+
+    sha512_init(&ctx);
+    for ( off = 0, step = 1; off < len; off += step, step = step * 2 + 1 )
+        sha512_update(&ctx, msg + off, step < len - off ? step : len - off);
+    sha512_final(&ctx, hash);
+}
+
+int main(void)
+{
+    bool fail = false;
+
+    /* Both in one go and incrementally */
+    for ( unsigned int pass = 0; pass < 2; ++pass )
+    {
+        for ( unsigned int i = 0; i < ARRAY_SIZE(tests); ++i )
+        {
+            const struct test *t = &tests[i];
+            u64 hash[SHA512_DIGEST_SIZE];
+
+            hash_msg(hash, t->msg, pass);
+
+            if ( memcmp(hash, t->hash, sizeof(hash)) == 0 )
+                continue;
+
+            fail = true;
+            printf("Fail: Message '%s'\n"
+                   "  Got:      ",
+                   t->msg);
+
+            dump_hash(hash);
+
+            printf("\n"
+                   "  Expected: ");
+
+            dump_hash(t->hash);
+            printf("\n");
+        }
+    }
+
+    if ( !fail )
+        printf("All ok\n");
+
+    return fail;
+}
@@ -0,0 +1,135 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "sm3.c"
+
+/* Deal with everything in terms of u64 rather than u8 */
+#undef SM3_DIGEST_SIZE
+#define SM3_DIGEST_SIZE (32 / 8)
+
+#define HASH(a, b, c, d) { _(a), _(b), _(c), _(d) }
+#define _(x) cpu_to_be64(0x ## x ## ULL)
+
+static const struct test {
+    const char *msg;
+    u64 hash[SM3_DIGEST_SIZE];
+} tests[] = {
+    {
+        "",
+        HASH(1ab21d8355cfa17f, 8e61194831e81a8f, 22bec8c728fefb74, 7ed035eb5082aa2b),
+    },
+    {
+        "a",
+        HASH(623476ac18f65a29, 09e43c7fec61b49c, 7e764a91a18ccb82, f1917a29c86c5e88),
+    },
+    {
+        "abc", /* GB/T 32905-2016 example 1 */
+        HASH(66c7f0f462eeedd9, d1f2d46bdc10e4e2, 4167c4875cf2f7a2, 297da02b8f4ba8e0),
+    },
+    {
+        "abcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcd"
+        "abcdabcd", /* GB/T 32905-2016 example 2 */
+        HASH(debe9ff92275b8a1, 38604889c18e5a4d, 6fdb70e5387e5765, 293dcba39c0c5732),
+    },
+    {
+        "The quick brown fox jumps over the lazy dog",
+        HASH(5fdfe814b8573ca0, 21983970fc79b221, 8c9570369b485968, 4e2e4c3fc76cb8ea),
+    },
+    {
+        "                                        ", /* 40 */
+        HASH(4235905b2e5935aa, 5be3807437d16bd2, bb4ce96d48c79410, 7447b422e2e3c5ea),
+    },
+    {
+        "                                                  ", /* 50 */
+        HASH(4c9a2f94cf22fbb1, 5aa5758ac284844c, 09b8933db8691242, 8b737a26b0b2565f),
+    },
+    {
+        "                                                        "
+        "    ", /* 60 */
+        HASH(35904194dcb660e8, 1f5c513cdd668068, d5bd7e175e486f14, cef5997ae6c6728a),
+    },
+    {
+        "                                                        "
+        "              ", /* 70 */
+        HASH(7eed4ab176261267, af0e9b00c7e6ba21, a529fba0986d23aa, 7283ccc680ad9e51),
+    },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 112 */
+        HASH(78bcfb586acd983d, 7fae8e6930157f15, 62019e2caf68f1c9, 8a855f1a95bb89bb),
+    },
+    {
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+        "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", /* 224, several blocks */
+        HASH(8af4f8d6681f3ab3, 02f62e629d5f318f, 07df23680dc7706e, af95b3cd3599d175),
+    },
+};
+
+static void dump_hash(const u64 *hash)
+{
+    for ( unsigned int j = 0; j < SM3_DIGEST_SIZE; ++j )
+        printf("%016"PRIx64, cpu_to_be64(hash[j]));
+}
+
+/*
+ * Either hash in one go, or feed the message in pieces of 1, 3, 7, ... bytes
+ * to exercise the partial block handling of the incremental interface.
+ */
+static void hash_msg(void *hash, const char *msg, bool split)
+{
+    size_t len = strlen(msg), off, step;
+    struct sm3_state ctx;
+
+    if ( !split )
+    {
+        sm3sum(hash, msg, len);
+        return;
+    }
+
+    sm3_init(&ctx);
+    for ( off = 0, step = 1; off < len; off += step, step = step * 2 + 1 )
+        sm3_update(&ctx, msg + off, step < len - off ? step : len - off);
+    sm3_final(&ctx, hash);
+}
+
+int main(void)
+{
+    bool fail = false;
+
+    /* Both in one go and incrementally */
+    for ( unsigned int pass = 0; pass < 2; ++pass )
+    {
+        for ( unsigned int i = 0; i < ARRAY_SIZE(tests); ++i )
+        {
+            const struct test *t = &tests[i];
+            u64 hash[SM3_DIGEST_SIZE];
+
+            hash_msg(hash, t->msg, pass);
+
+            if ( memcmp(hash, t->hash, sizeof(hash)) == 0 )
+                continue;
+
+            fail = true;
+            printf("Fail: Message '%s'\n"
+                   "  Got:      ",
+                   t->msg);
+
+            dump_hash(hash);
+
+            printf("\n"
+                   "  Expected: ");
+
+            dump_hash(t->hash);
+            printf("\n");
+        }
+    }
+
+    if ( !fail )
+        printf("All ok\n");
+
+    return fail;
+}
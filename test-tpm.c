@@ -0,0 +1,1305 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <endian.h>
+#include <errno.h>
+
+#include "tpmlib/tpm.h"
+#include "tpmlib/tpmbuff.h"
+#include "tpmlib/tpm_common.h"
+#include "tpmlib/tis.h"
+#include "tpmlib/tpm1.h"
+#include "tpmlib/tpm2.h"
+#include "tpmlib/tpm_trace.h"
+
+/*
+ * tpmlib, built for the host, against a model of a TPM's TIS or CRB
+ * registers.  The model keeps its own clock, in nanoseconds: every register
+ * access and cpu_relax() moves it on, and the TPM takes a configurable time
+ * to grant a locality, to become ready and to execute each command.  So the
+ * transports and their timeouts can be tested, and what a change costs in
+ * time and register accesses seen, without hardware.
+ *
+ * The model answers the commands tpmlib sends itself, plus a vendor command
+ * moving patterns of any size each way, for the streaming and spill paths.
+ * Its digests are a function of the data, not real hashes.
+ */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define NS_PER_US       1000
+#define NEVER           (~0ULL >> 1)
+
+/* CRB registers, as in crb.c */
+#define CRB_LOC_STATE   0x00
+#define CRB_LOC_CTRL    0x08
+#define CRB_LOC_STS     0x0C
+#define CRB_INTF_ID     0x30
+#define CRB_CTRL_REQ    0x40
+#define CRB_CTRL_STS    0x44
+#define CRB_CTRL_CANCEL 0x48
+#define CRB_CTRL_START  0x4C
+#define CRB_RSP_SIZE    0x64
+#define CRB_BUFFER      0x80
+#define CRB_BUFFER_SIZE 3966
+
+/*
+ * Vendor command: a u32 response size, then bytes of pattern(i, 3).  The
+ * response is that many bytes of pattern(i, 7).
+ */
+#define SIM_CC_PATTERN  0x20000001
+#define SIM_SEQ_HANDLE  0x80000000
+
+#define TPM_RC_COMMAND_CODE 0x143
+#define TPM_RC_FAILURE      0x101
+
+enum { IDLE, READY, RECEPTION, EXECUTION, COMPLETION };
+
+static struct sim {
+    /* The part being modelled */
+    enum tpm_hw_intf intf;
+    enum tpm_family family;
+    u32 vendor;
+    bool fifo_wide;
+    u16 burst;                  /* TIS burstCount */
+    u32 banks;                  /* Allocated, out of the five below */
+    u32 tpm1_timeouts[4];       /* As TPM_CAP_PROP_TIS_TIMEOUT reports them */
+    u32 tpm1_duration;
+
+    /* Costs, in ns */
+    u64 access_ns;              /* Each register access */
+    u64 relax_ns;               /* Each cpu_relax() */
+    u64 locality_ns;            /* Granting a locality */
+    u64 ready_ns;               /* Idle or completion to ready */
+    u64 exec_ns;                /* Executing a command... */
+    u32 slow_code;              /* ...unless it is this one */
+    u64 slow_ns;
+    u32 fail_code;              /* Answer this command with just... */
+    u32 fail_rc;                /* ...this response code */
+
+    /* State */
+    u64 now;
+    u8 active, requested;
+    u64 grant_at;
+    int state;
+    u64 ready_at, done_at;
+    u8 exec_locality;
+    u32 burst_left;             /* FIFO bytes allowed before STS is read */
+    u8 cmd[4096];
+    u32 cmd_len;
+    u8 rsp[4096];
+    u32 rsp_len, rsp_off;
+    bool seq_open;
+    u32 seq_sum;
+
+    /* What happened */
+    u32 accesses, commands, errors;
+} sim;
+
+/* Registers of localities 0-4, for the CRB data buffers */
+static u8 mmio[5][0x1000] __attribute__((aligned(0x1000)));
+uintptr_t tpm_mmio_base;
+
+static const u16 algs[] = {
+    TPM_ALG_SHA1, TPM_ALG_SHA256, TPM_ALG_SHA384, TPM_ALG_SHA512,
+    TPM_ALG_SM3_256,
+};
+
+static bool fail;
+static const char *scenario;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if ( !(cond) )                                                  \
+        {                                                               \
+            fail = true;                                                \
+            printf("Fail: %s, line %d: %s\n", scenario, __LINE__, #cond); \
+        }                                                               \
+    } while ( 0 )
+
+static void sim_error(const char *what)
+{
+    sim.errors++;
+    printf("Fail: %s: model: %s\n", scenario, what);
+}
+
+static u8 pattern(u32 i, u32 k)
+{
+    return i * k + 1;
+}
+
+static u16 get16(const u8 *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static u32 get32(const u8 *p)
+{
+    return ((u32)get16(p) << 16) | get16(p + 2);
+}
+
+static u8 *put16(u8 *p, u16 v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+
+    return p + 2;
+}
+
+static u8 *put32(u8 *p, u32 v)
+{
+    return put16(put16(p, v >> 16), v);
+}
+
+static void rsp8(u8 v)
+{
+    sim.rsp[sim.rsp_len++] = v;
+}
+
+static void rsp16(u16 v)
+{
+    put16(sim.rsp + sim.rsp_len, v);
+    sim.rsp_len += 2;
+}
+
+static void rsp32(u32 v)
+{
+    put32(sim.rsp + sim.rsp_len, v);
+    sim.rsp_len += 4;
+}
+
+/* parameterSize of 0 and a response auth per session, around the params */
+static void rsp_auths(u32 n)
+{
+    while ( n-- )
+    {
+        rsp16(0);
+        rsp8(1);
+        rsp16(0);
+    }
+}
+
+/* The model's "digest" of data summing to sum, in bank alg */
+static void sim_digest(u8 *d, u16 alg, u32 sum)
+{
+    for ( u32 i = 0; i < tpm_digest_size(alg); ++i )
+        d[i] = alg + i + sum;
+}
+
+static void rsp_digests(u32 sum)
+{
+    u32 n = 0;
+
+    for ( u32 i = 0; i < ARRAY_SIZE(algs); ++i )
+        n += !!(sim.banks & TPM_BANK(algs[i]));
+
+    rsp32(n);
+    for ( u32 i = 0; i < ARRAY_SIZE(algs); ++i )
+    {
+        if ( !(sim.banks & TPM_BANK(algs[i])) )
+            continue;
+
+        rsp16(algs[i]);
+        sim_digest(sim.rsp + sim.rsp_len, algs[i], sum);
+        sim.rsp_len += tpm_digest_size(algs[i]);
+    }
+}
+
+/* Sum of the TPM2B at p, the last parameter of a command */
+static u32 sim_tpm2b_sum(const u8 *p, const u8 *end)
+{
+    u32 size = get16(p), sum = 0;
+
+    if ( p + 2 + size != end )
+        sim_error("TPM2B doesn't end the command");
+    if ( size > TPM2_MAX_DIGEST_BUFFER )
+        sim_error("TPM2B larger than the TPM takes");
+
+    for ( u32 i = 0; i < size && p + 2 + i < end; ++i )
+        sum += p[2 + i];
+
+    return sum;
+}
+
+static void sim_tpm2(u32 code, const u8 *p, const u8 *end)
+{
+    /* After the pcrHandle or sequenceHandle, authorizationSize and auth */
+    const u8 *param1 = p + 4 + 4 + 9;
+    u32 sum;
+
+    switch ( code )
+    {
+    case TPM_CC_GET_CAPABILITY:
+        rsp8(0);
+        rsp32(TPM_CAP_PCRS);
+        rsp32(ARRAY_SIZE(algs));
+        for ( u32 i = 0; i < ARRAY_SIZE(algs); ++i )
+        {
+            u8 sel = (sim.banks & TPM_BANK(algs[i])) ? 0xff : 0;
+
+            rsp16(algs[i]);
+            rsp8(3);
+            rsp8(sel);
+            rsp8(sel);
+            rsp8(sel);
+        }
+        break;
+
+    case TPM_CC_PCR_EXTEND:
+        rsp32(0);
+        rsp_auths(1);
+        break;
+
+    case TPM_CC_PCR_EVENT:
+        rsp32(0);
+        rsp_digests(sim_tpm2b_sum(param1, end));
+        rsp_auths(1);
+        break;
+
+    case TPM_CC_HASH_SEQUENCE_START:
+        if ( sim.seq_open )
+            sim_error("sequence left open");
+        sim.seq_open = true;
+        sim.seq_sum = 0;
+        rsp32(SIM_SEQ_HANDLE);
+        break;
+
+    case TPM_CC_SEQUENCE_UPDATE:
+        if ( !sim.seq_open || get32(p) != SIM_SEQ_HANDLE )
+            sim_error("update of no sequence");
+        sim.seq_sum += sim_tpm2b_sum(param1, end);
+        rsp32(0);
+        rsp_auths(1);
+        break;
+
+    case TPM_CC_EVENT_SEQUENCE_COMPLETE:
+        /* Two handles and two auths */
+        if ( !sim.seq_open || get32(p + 4) != SIM_SEQ_HANDLE )
+            sim_error("completion of no sequence");
+        sum = sim.seq_sum + sim_tpm2b_sum(p + 8 + 4 + 18, end);
+        sim.seq_open = false;
+        rsp32(0);
+        rsp_digests(sum);
+        rsp_auths(2);
+        break;
+
+    case TPM_CC_FLUSH_CONTEXT:
+        sim.seq_open = false;
+        break;
+
+    default:
+        /* The header's code */
+        put32(sim.rsp + 6, TPM_RC_COMMAND_CODE);
+        break;
+    }
+}
+
+static void sim_tpm1(u32 code, const u8 *p)
+{
+    switch ( code )
+    {
+    case TPM_ORD_GET_CAPABILITY:
+        if ( get32(p + 8) == TPM_CAP_PROP_TIS_TIMEOUT )
+        {
+            rsp32(16);
+            for ( u32 i = 0; i < 4; ++i )
+                rsp32(sim.tpm1_timeouts[i]);
+        }
+        else
+        {
+            rsp32(12);
+            rsp32(sim.tpm1_duration);
+            rsp32(sim.tpm1_duration * 10);
+            rsp32(sim.tpm1_duration * 100);
+        }
+        break;
+
+    case TPM_ORD_EXTEND:
+        for ( u32 i = 0; i < SHA1_DIGEST_SIZE; ++i )
+            rsp8(p[4 + i] ^ 0x5a);
+        break;
+
+    default:
+        put32(sim.rsp + 6, TPM_RC_COMMAND_CODE);
+        break;
+    }
+}
+
+/* Start executing the command in sim.cmd, building its response */
+static void sim_execute(void)
+{
+    const u8 *p = sim.cmd + sizeof(struct tpm_header);
+    const u8 *end = sim.cmd + sim.cmd_len;
+    u32 code = get32(sim.cmd + 6), n;
+
+    if ( sim.cmd_len < sizeof(struct tpm_header) ||
+         get32(sim.cmd + 2) != sim.cmd_len )
+        sim_error("command size doesn't match the header");
+
+    sim.commands++;
+    sim.rsp_len = sizeof(struct tpm_header);
+    sim.rsp_off = 0;
+    put16(sim.rsp, sim.family == TPM12 ? TPM_TAG_RSP_COMMAND
+                                       : get16(sim.cmd));
+    put32(sim.rsp + 6, 0);
+
+    if ( code == SIM_CC_PATTERN )
+    {
+        n = get32(p);
+        for ( p += 4; p < end; ++p )
+            if ( *p != pattern(p - sim.cmd - 14, 3) )
+            {
+                sim_error("pattern command corrupted");
+                break;
+            }
+        for ( u32 i = 0; i < n; ++i )
+            rsp8(pattern(i, 7));
+    }
+    else if ( sim.family == TPM12 )
+        sim_tpm1(code, p);
+    else
+        sim_tpm2(code, p, end);
+
+    if ( code == sim.fail_code )
+    {
+        sim.rsp_len = sizeof(struct tpm_header);
+        put32(sim.rsp + 6, sim.fail_rc);
+    }
+
+    put32(sim.rsp + 2, sim.rsp_len);
+
+    sim.state = EXECUTION;
+    sim.exec_locality = sim.active;
+    sim.done_at = sim.now + (code == sim.slow_code ? sim.slow_ns
+                                                   : sim.exec_ns);
+}
+
+/* Make whatever the TPM was doing in the background happen */
+static void sim_update(void)
+{
+    if ( sim.requested != TPM_NO_LOCALITY && sim.now >= sim.grant_at &&
+         sim.active == TPM_NO_LOCALITY )
+    {
+        sim.active = sim.requested;
+        sim.requested = TPM_NO_LOCALITY;
+    }
+
+    if ( sim.state == EXECUTION && sim.now >= sim.done_at )
+    {
+        if ( sim.intf == TPM_CRB )
+        {
+            memcpy(mmio[sim.exec_locality] + CRB_BUFFER, sim.rsp,
+                   sim.rsp_len);
+            sim.state = READY;
+        }
+        else
+            sim.state = COMPLETION;
+    }
+}
+
+static void sim_access(void)
+{
+    sim.accesses++;
+    sim.now += sim.access_ns;
+    sim_update();
+}
+
+static u32 sim_sts(void)
+{
+    u32 sts = STS_VALID, burst = 0;
+
+    switch ( sim.state )
+    {
+    case READY:
+        if ( sim.now >= sim.ready_at )
+        {
+            sts |= STS_COMMAND_READY;
+            burst = sim.burst;
+        }
+        break;
+
+    case RECEPTION:
+        if ( sim.cmd_len < 6 || sim.cmd_len < get32(sim.cmd + 2) )
+            sts |= STS_DATA_EXPECT;
+        burst = sim.burst;
+        break;
+
+    case COMPLETION:
+        if ( sim.rsp_off < sim.rsp_len )
+        {
+            sts |= STS_DATA_AVAIL;
+            burst = sim.burst;
+        }
+        break;
+    }
+
+    sim.burst_left = burst;
+
+    return sts | (burst << 8);
+}
+
+static void sim_fifo_write(u32 val, u32 n)
+{
+    if ( sim.state == READY && sim.now >= sim.ready_at )
+    {
+        sim.state = RECEPTION;
+        sim.cmd_len = 0;
+    }
+
+    if ( sim.state != RECEPTION )
+    {
+        sim_error("FIFO write outside reception");
+        return;
+    }
+    if ( n > sim.burst_left )
+    {
+        sim_error("FIFO write beyond burstCount");
+        return;
+    }
+    if ( sim.cmd_len + n > sizeof(sim.cmd) ||
+         (sim.cmd_len >= 6 && sim.cmd_len + n > get32(sim.cmd + 2)) )
+    {
+        sim_error("FIFO write beyond the command");
+        return;
+    }
+
+    sim.burst_left -= n;
+    memcpy(sim.cmd + sim.cmd_len, &val, n);
+    sim.cmd_len += n;
+}
+
+static u32 sim_fifo_read(u32 n)
+{
+    u32 val = ~0;
+
+    if ( sim.state != COMPLETION || sim.rsp_off + n > sim.rsp_len )
+    {
+        sim_error("FIFO read with no response");
+        return val;
+    }
+    if ( n > sim.burst_left )
+        sim_error("FIFO read beyond burstCount");
+
+    sim.burst_left -= n;
+    memcpy(&val, sim.rsp + sim.rsp_off, n);
+    sim.rsp_off += n;
+
+    return val;
+}
+
+static u32 sim_read(u32 field, u32 n)
+{
+    u8 l = field >> 12;
+    u32 reg = field & 0xfff;
+
+    sim_access();
+
+    if ( reg == TPM_INTF_CAPABILITY_0 && sim.intf == TPM_TIS )
+        return ((sim.family == TPM12 ? TPM12_TIS_INTF_13
+                                     : TPM20_TIS_INTF_13) << 28) |
+               (sim.fifo_wide ? 3 << 9 : 0);
+    if ( reg == TPM_INTERFACE_ID_0 )
+        return sim.intf == TPM_CRB ? TPM_CRB_INTF_ACTIVE : 0;
+
+    if ( sim.intf == TPM_CRB )
+    {
+        switch ( reg )
+        {
+        case CRB_LOC_STATE:
+            return 0x80 | (sim.active == TPM_NO_LOCALITY ? 0
+                           : 0x02 | (sim.active << 2));
+        case CRB_LOC_STS:
+            return sim.active == l;
+        case CRB_INTF_ID + 4:
+            return sim.vendor & 0xffff;
+        case CRB_CTRL_REQ:
+            return sim.state == READY && sim.now < sim.ready_at;
+        case CRB_CTRL_STS:
+            return sim.state == IDLE ? 2 : 0;
+        case CRB_CTRL_START:
+            return sim.state == EXECUTION;
+        case CRB_RSP_SIZE:
+            return CRB_BUFFER_SIZE;
+        }
+    }
+    else
+    {
+        if ( reg == (ACCESS(0) & 0xfff) )
+            return ACCESS_VALID | (sim.active == l ? ACCESS_ACTIVE_LOCALITY
+                                                   : 0);
+        if ( reg == (DID_VID(0) & 0xfff) )
+            return sim.vendor;
+
+        if ( l != sim.active )
+            return ~0;
+
+        if ( reg == (STS(0) & 0xfff) )
+            return sim_sts() & (n == 1 ? 0xff : ~0);
+        if ( reg == (DATA_FIFO(0) & 0xfff) )
+        {
+            if ( n == 4 && !sim.fifo_wide )
+                sim_error("wide FIFO read");
+            return sim_fifo_read(n);
+        }
+    }
+
+    return ~0;
+}
+
+static void sim_write(u32 val, u32 field, u32 n)
+{
+    u8 l = field >> 12;
+    u32 reg = field & 0xfff;
+
+    sim_access();
+
+    if ( sim.intf == TPM_CRB )
+    {
+        switch ( reg )
+        {
+        case CRB_LOC_CTRL:
+            if ( val & 1 )
+            {
+                sim.requested = l;
+                sim.grant_at = sim.now + sim.locality_ns;
+            }
+            if ( (val & 2) && sim.active == l )
+                sim.active = TPM_NO_LOCALITY;
+            break;
+
+        case CRB_CTRL_REQ:
+            if ( (val & 1) && sim.state == IDLE )
+            {
+                sim.state = READY;
+                sim.ready_at = sim.now + sim.ready_ns;
+            }
+            if ( (val & 2) && sim.state != EXECUTION )
+                sim.state = IDLE;
+            break;
+
+        case CRB_CTRL_CANCEL:
+            if ( val == 1 && sim.state == EXECUTION )
+                sim.state = READY;
+            break;
+
+        case CRB_CTRL_START:
+            if ( val != 1 || l != sim.active || sim.state != READY ||
+                 sim.now < sim.ready_at )
+            {
+                sim_error("start while not ready");
+                return;
+            }
+
+            sim.cmd_len = get32(mmio[l] + CRB_BUFFER + 2);
+            if ( sim.cmd_len > CRB_BUFFER_SIZE )
+            {
+                sim_error("command larger than the buffer");
+                return;
+            }
+            memcpy(sim.cmd, mmio[l] + CRB_BUFFER, sim.cmd_len);
+            sim_execute();
+            break;
+        }
+
+        return;
+    }
+
+    if ( reg == (ACCESS(0) & 0xfff) )
+    {
+        if ( val & ACCESS_REQUEST_USE )
+        {
+            sim.requested = l;
+            sim.grant_at = sim.now + sim.locality_ns;
+        }
+        if ( (val & ACCESS_RELINQUISH_LOCALITY) && sim.active == l )
+            sim.active = TPM_NO_LOCALITY;
+        return;
+    }
+
+    if ( l != sim.active )
+    {
+        sim_error("write to an inactive locality");
+        return;
+    }
+
+    if ( reg == (STS(0) & 0xfff) )
+    {
+        if ( val & STS_COMMAND_READY && sim.state != EXECUTION &&
+             !(sim.state == READY && sim.now >= sim.ready_at) )
+        {
+            sim.state = READY;
+            sim.ready_at = sim.now + sim.ready_ns;
+        }
+        if ( val & STS_GO )
+        {
+            if ( sim.state != RECEPTION || sim.cmd_len < 6 ||
+                 sim.cmd_len != get32(sim.cmd + 2) )
+            {
+                sim_error("GO without a whole command");
+                return;
+            }
+            sim_execute();
+        }
+    }
+    else if ( reg == (DATA_FIFO(0) & 0xfff) )
+    {
+        if ( n == 4 && !sim.fifo_wide )
+            sim_error("wide FIFO write");
+        sim_fifo_write(val, n);
+    }
+}
+
+/* The platform, for tpmio.c */
+u64 rdtsc(void)
+{
+    return sim.now;
+}
+
+void cpu_relax(void)
+{
+    sim.now += sim.relax_ns;
+    sim_update();
+}
+
+u32 tpm_tsc_per_us(void)
+{
+    return NS_PER_US;
+}
+
+u8 tpm_read8(u32 field)
+{
+    return sim_read(field, 1);
+}
+
+void tpm_write8(unsigned char val, u32 field)
+{
+    sim_write(val, field, 1);
+}
+
+u32 tpm_read32(u32 field)
+{
+    return sim_read(field, 4);
+}
+
+void tpm_write32(unsigned int val, u32 field)
+{
+    sim_write(val, field, 4);
+}
+
+u8 tpm_read8_relaxed(u32 field)
+{
+    return sim_read(field, 1);
+}
+
+void tpm_write8_relaxed(unsigned char val, u32 field)
+{
+    sim_write(val, field, 1);
+}
+
+u32 tpm_read32_relaxed(u32 field)
+{
+    return sim_read(field, 4);
+}
+
+void tpm_write32_relaxed(unsigned int val, u32 field)
+{
+    sim_write(val, field, 4);
+}
+
+/* A freshly reset part, with costs like those of a typical LPC TPM */
+static void sim_reset(const char *name, enum tpm_hw_intf intf,
+                      enum tpm_family family)
+{
+    memset(&sim, 0, sizeof(sim));
+    memset(mmio, 0, sizeof(mmio));
+    tpm_mmio_base = (uintptr_t)mmio;
+
+    scenario = name;
+    sim.intf = intf;
+    sim.family = family;
+    sim.vendor = 0x001b15d1;
+    sim.fifo_wide = true;
+    sim.burst = 32;
+    sim.banks = TPM_BANK(TPM_ALG_SHA1) | TPM_BANK(TPM_ALG_SHA256) |
+                TPM_BANK(TPM_ALG_SHA384);
+    sim.tpm1_duration = 20000;
+
+    sim.access_ns = 1000;
+    sim.relax_ns = 50;
+    sim.locality_ns = 10 * NS_PER_US;
+    sim.ready_ns = 20 * NS_PER_US;
+    sim.exec_ns = 200 * NS_PER_US;
+
+    sim.active = TPM_NO_LOCALITY;
+    sim.requested = TPM_NO_LOCALITY;
+    sim.state = IDLE;
+}
+
+static const struct part {
+    const char *name;
+    enum tpm_hw_intf intf;
+    enum tpm_family family;
+    bool fifo_wide;
+    u16 burst;
+} parts[] = {
+    /* Those the TPM make option builds in */
+#if defined(ENABLE_TPM20) && defined(ENABLE_TPM_TIS)
+    { "TIS 2.0, wide FIFO, burst 32", TPM_TIS, TPM20, true,  32 },
+    { "TIS 2.0, wide FIFO, burst 3",  TPM_TIS, TPM20, true,  3 },
+    { "TIS 2.0, byte FIFO, burst 64", TPM_TIS, TPM20, false, 64 },
+    { "TIS 2.0, byte FIFO, burst 1",  TPM_TIS, TPM20, false, 1 },
+#endif
+#if defined(ENABLE_TPM12) && defined(ENABLE_TPM_TIS)
+    { "TIS 1.2, byte FIFO, burst 8",  TPM_TIS, TPM12, false, 8 },
+#endif
+#if defined(ENABLE_TPM20) && defined(ENABLE_TPM_CRB)
+    { "CRB 2.0",                      TPM_CRB, TPM20, true,  0 },
+#endif
+};
+
+/* Name what a part is being tested for */
+static void sim_scenario(const struct part *p, const char *what)
+{
+    static char name[80];
+
+    snprintf(name, sizeof(name), "%s, %s", p->name, what);
+    scenario = name;
+}
+
+static struct tpm *sim_start(const struct part *p)
+{
+    struct tpm *t;
+
+    sim_reset(p->name, p->intf, p->family);
+    sim.fifo_wide = p->fifo_wide;
+    sim.burst = p->burst;
+
+    t = enable_tpm();
+    CHECK(t != NULL);
+    if ( t == NULL )
+        return NULL;
+
+    /* SKL enables the TPM once, so forget the banks of the last part */
+    t->banks = 0;
+    t->status = 0;
+
+    /* As SKL does */
+    CHECK(tpm_request_locality(t, 2) == 2);
+    CHECK(t->buff != NULL);
+
+    return t;
+}
+
+static void sim_stop(struct tpm *t)
+{
+    free_tpm(t);
+    CHECK(sim.active == TPM_NO_LOCALITY);
+    CHECK(sim.errors == 0);
+}
+
+/* The TPM2_PCR_Extend tpmlib should send, into p */
+static u32 tpm2_extend_bytes(u8 *p, u32 pcr, struct tpm_pcr_digest *d,
+                             u32 n)
+{
+    u8 *s = p;
+
+    p = put16(p, TPM_ST_SESSIONS);
+    p = put32(p, 0);
+    p = put32(p, TPM_CC_PCR_EXTEND);
+    p = put32(p, pcr);
+    p = put32(p, 9);
+    p = put32(p, TPM_RS_PW);
+    p = put16(p, 0);
+    *p++ = 0;
+    p = put16(p, 0);
+    p = put32(p, n);
+    for ( u32 i = 0; i < n; ++i )
+    {
+        p = put16(p, d[i].alg);
+        memcpy(p, d[i].digest, tpm_digest_size(d[i].alg));
+        p += tpm_digest_size(d[i].alg);
+    }
+    put32(s + 2, p - s);
+
+    return p - s;
+}
+
+static void test_extend(const struct part *p)
+{
+    u8 sha1[SHA1_SIZE], sha256[SHA256_SIZE], want[128];
+    struct tpm_pcr_digest d[] = {
+        { TPM_ALG_SHA1, sha1 },
+        { TPM_ALG_SHA256, sha256 },
+    };
+    struct tpm *t = sim_start(p);
+    u64 start;
+    u32 len, accesses;
+
+    if ( t == NULL )
+        return;
+
+    CHECK(t->intf == p->intf);
+    CHECK(t->family == p->family);
+    if ( p->intf == TPM_TIS )
+        CHECK(t->vendor == sim.vendor);
+
+    memset(sha1, 0x11, sizeof(sha1));
+    memset(sha256, 0x22, sizeof(sha256));
+
+    if ( p->family == TPM12 )
+    {
+        CHECK(tpm_pcr_banks(t) == TPM_BANK(TPM_ALG_SHA1));
+        CHECK(tpm_extend_pcr_digests(t, 17, d, 2) == -EINVAL);
+
+        CHECK(tpm_extend_pcr(t, 17, TPM_ALG_SHA1, sha1) == 0);
+        len = put16(want, TPM_TAG_RQU_COMMAND) - want;
+        len = put32(want + len, 34) - want;
+        len = put32(want + len, TPM_ORD_EXTEND) - want;
+        len = put32(want + len, 17) - want;
+        memcpy(want + len, sha1, sizeof(sha1));
+        len += sizeof(sha1);
+    }
+    else
+    {
+        CHECK(tpm_pcr_banks(t) == sim.banks);
+
+        start = sim.now;
+        accesses = sim.accesses;
+        CHECK(tpm_extend_pcr_digests(t, 17, d, 2) == 0);
+        printf("  %-30s PCR extend %5"PRIu64" us, %4u MMIO accesses\n",
+               p->name, (sim.now - start) / NS_PER_US,
+               sim.accesses - accesses);
+
+        len = tpm2_extend_bytes(want, 17, d, 2);
+    }
+
+    CHECK(sim.cmd_len == len);
+    CHECK(memcmp(sim.cmd, want, len) == 0);
+
+    sim_stop(t);
+}
+
+#if defined(ENABLE_TPM12) && defined(ENABLE_TPM_TIS)
+/* A TPM 1.2 reports its timeouts, in us or (some parts) in ms */
+static void test_tpm1_timeouts(void)
+{
+    static const struct {
+        const char *name;
+        u32 vendor;
+        u32 reported[4], duration;
+        struct tpm_timeouts want;
+    } cases[] = {
+        { "TPM 1.2 timeouts in us", 0x001b15d1,
+          { 100000, 200000, 300000, 400000 }, 5000,
+          { 100000, 200000, 300000, 400000, 5000 } },
+        { "TPM 1.2 timeouts in ms", 0x001b15d1,
+          { 100, 200, 300, 400 }, 5,
+          { 100000, 200000, 300000, 400000, 5000 } },
+        { "TPM 1.2 timeouts not reported", 0x001b15d1,
+          { 0, 0, 0, 0 }, 0,
+          { TIMEOUT_A, TIMEOUT_B, TPM1_TIMEOUT_C, TPM1_TIMEOUT_D,
+            DURATION_A } },
+        { "TPM 1.2 timeouts of a quirky part", 0x32041114,
+          { 1, 1, 1, 1 }, 5000,
+          { TIMEOUT_A, TIMEOUT_B, TPM1_TIMEOUT_C, TPM1_TIMEOUT_D, 5000 } },
+    };
+
+    for ( u32 i = 0; i < ARRAY_SIZE(cases); ++i )
+    {
+        struct tpm *t;
+
+        sim_reset(cases[i].name, TPM_TIS, TPM12);
+        sim.vendor = cases[i].vendor;
+        memcpy(sim.tpm1_timeouts, cases[i].reported,
+               sizeof(sim.tpm1_timeouts));
+        sim.tpm1_duration = cases[i].duration;
+
+        t = enable_tpm();
+        CHECK(t != NULL);
+        CHECK(memcmp(&tpm_timeouts, &cases[i].want,
+                     sizeof(tpm_timeouts)) == 0);
+        CHECK(sim.errors == 0);
+    }
+}
+#endif
+
+/*
+ * A TPM which never does what it is asked is given up on after the timeout
+ * for that state, rather than straight away or never.
+ */
+static void test_timeouts(void)
+{
+    u8 sha1[SHA1_SIZE] = { 0 };
+
+    for ( u32 i = 0; i < ARRAY_SIZE(parts); ++i )
+    {
+        const struct part *p = &parts[i];
+        struct tpm *t;
+        u64 start;
+
+        sim_reset(p->name, p->intf, p->family);
+        sim_scenario(p, "locality never granted");
+        sim.locality_ns = NEVER;
+        CHECK(enable_tpm() == NULL);
+        CHECK(sim.now >= (u64)TIMEOUT_A * NS_PER_US);
+        CHECK(sim.now < (u64)TIMEOUT_A * NS_PER_US * 11 / 10);
+
+        t = sim_start(p);
+        if ( t == NULL )
+            continue;
+
+        sim_scenario(p, "command never completes");
+        sim.exec_ns = NEVER;
+        start = sim.now;
+        CHECK(tpm_extend_pcr(t, 17, TPM_ALG_SHA1, sha1) == -EIO);
+        CHECK(sim.now - start >= (u64)TPM_CMD_TIMEOUT * NS_PER_US);
+        CHECK(sim.now - start < (u64)TPM_CMD_TIMEOUT * NS_PER_US * 11 / 10);
+        CHECK(sim.errors == 0);
+
+        if ( p->intf != TPM_TIS )
+            continue;
+
+        t = sim_start(p);
+        if ( t == NULL )
+            continue;
+
+        sim_scenario(p, "never ready");
+        sim.ready_ns = NEVER;
+        start = sim.now;
+        /* Streaming fails the first put, so as -ENOMEM */
+        CHECK(tpm_extend_pcr(t, 17, TPM_ALG_SHA1, sha1) < 0);
+        CHECK(sim.now - start >= (u64)TIMEOUT_B * NS_PER_US);
+        CHECK(sim.now - start < (u64)TIMEOUT_B * NS_PER_US * 11 / 10);
+        CHECK(sim.errors == 0);
+    }
+}
+
+/* A submitted extend runs while the caller gets on with other work */
+static void test_overlap(void)
+{
+    u8 sha1[SHA1_SIZE] = { 0 };
+    struct tpm_pcr_digest d = { TPM_ALG_SHA1, sha1 };
+
+    for ( u32 i = 0; i < ARRAY_SIZE(parts); ++i )
+    {
+        struct tpm *t;
+        u64 start;
+
+        /* A TPM 1.2 extend completes before returning */
+        if ( parts[i].family != TPM20 )
+            continue;
+
+        t = sim_start(&parts[i]);
+        if ( t == NULL )
+            continue;
+
+        sim.slow_code = TPM_CC_PCR_EXTEND;
+        sim.slow_ns = 5000 * NS_PER_US;
+        CHECK(tpm_extend_pcr_submit(t, 17, &d, 1) == 0);
+        CHECK(sim.state == EXECUTION);
+        CHECK(t->pending);
+
+        /* Hash for a while, then collect the result */
+        sim.now += 6000 * NS_PER_US;
+        start = sim.now;
+        CHECK(tpm_complete(t) == 0);
+        CHECK(sim.now - start < 100 * NS_PER_US);
+        CHECK(!t->pending);
+
+        /* A failed extend is still reported once the next one is sent */
+        sim.fail_code = TPM_CC_PCR_EXTEND;
+        sim.fail_rc = TPM_RC_FAILURE;
+        CHECK(tpm_extend_pcr_submit(t, 17, &d, 1) == 0);
+        sim.fail_code = 0;
+        CHECK(tpm_extend_pcr_submit(t, 17, &d, 1) == 0);
+        CHECK(tpm_complete(t) == -EAGAIN);
+        CHECK(tpm_complete(t) == 0);
+
+        CHECK(tpm_extend_pcr_submit(t, 17, &d, 0) == -EINVAL);
+        CHECK(!t->pending);
+
+        sim_stop(t);
+    }
+}
+
+/* Send a pattern command of cmd_size bytes, for rsp_size bytes back */
+static int pattern_transmit(struct tpm *t, u32 cmd_size, u32 rsp_size)
+{
+    struct tpmbuff *b = t->buff;
+    struct tpm_header *hdr;
+    u32 i, n;
+    u8 *p;
+
+    tpmb_free(b);
+    hdr = (struct tpm_header *)tpmb_reserve(b);
+    if ( hdr == NULL )
+        return -ENOMEM;
+
+    hdr->tag = htobe16(TPM_ST_NO_SESSIONS);
+    hdr->size = htobe32(sizeof(*hdr) + 4 + cmd_size);
+    hdr->code = htobe32(SIM_CC_PATTERN);
+
+    p = tpmb_put(b, 4);
+    if ( p == NULL )
+        return -ENOMEM;
+    put32(p, rsp_size);
+
+    /* In pieces, as a command would be built */
+    for ( i = 0; i < cmd_size; i += n )
+    {
+        n = cmd_size - i < 100 ? cmd_size - i : 100;
+        p = tpmb_put(b, n);
+        if ( p == NULL )
+            return -ENOMEM;
+        for ( u32 j = 0; j < n; ++j )
+            p[j] = pattern(i + j, 3);
+    }
+
+    return tpm_transmit(t);
+}
+
+static bool pattern_check(struct tpm *t, u32 rsp_size)
+{
+    const u8 *p = t->buff->head + sizeof(struct tpm_header);
+
+    if ( tpmb_size(t->buff) != sizeof(struct tpm_header) + rsp_size )
+        return false;
+
+    for ( u32 i = 0; i < rsp_size; ++i )
+        if ( p[i] != pattern(i, 7) )
+            return false;
+
+    return true;
+}
+
+/*
+ * Commands of any size stream through the small TIS buffer, and responses
+ * larger than it need a spill area.
+ */
+static void test_stream(void)
+{
+    static u8 spill[2048];
+
+    for ( u32 i = 0; i < ARRAY_SIZE(parts); ++i )
+    {
+        struct tpm *t;
+        u8 *head;
+
+        if ( parts[i].family != TPM20 )
+            continue;
+
+        t = sim_start(&parts[i]);
+        if ( t == NULL )
+            continue;
+
+        head = t->buff->head;
+
+        CHECK(pattern_transmit(t, 1500, 16) == 0);
+        CHECK(pattern_check(t, 16));
+        CHECK(sim.cmd_len == sizeof(struct tpm_header) + 4 + 1500);
+
+        if ( t->intf == TPM_TIS )
+        {
+            CHECK(t->buff->truesize < 1000);
+            CHECK(pattern_transmit(t, 8, 1000) == -EIO);
+
+            CHECK(tpmb_spill(t->buff, spill, sizeof(spill)) == 0);
+            CHECK(pattern_transmit(t, 8, 1000) == 0);
+            CHECK(t->buff->head == spill);
+            CHECK(pattern_check(t, 1000));
+
+            tpmb_free(t->buff);
+            CHECK(t->buff->head == head);
+
+            /* A command never spills, it still streams */
+            CHECK(pattern_transmit(t, 1500, 16) == 0);
+            CHECK(t->buff->head == head);
+            CHECK(pattern_check(t, 16));
+        }
+        else
+        {
+            CHECK(tpmb_spill(t->buff, spill, sizeof(spill)) == -EINVAL);
+            CHECK(pattern_transmit(t, 8, 1000) == 0);
+            CHECK(pattern_check(t, 1000));
+        }
+
+        sim_stop(t);
+    }
+}
+
+#ifdef ENABLE_TPM_HASH
+/*
+ * The TPM hashes small data with TPM2_PCR_Event, and more in a sequence.  The
+ * digests of three banks only fit a TIS buffer with a spill area.
+ */
+static void test_pcr_event(void)
+{
+    static u8 data[3000];
+    static u8 spill[TPM_SPILL_SIZE];
+    u32 sizes[] = { 0, 100, 127, 1024, 1025, 3000 };
+
+    for ( u32 i = 0; i < sizeof(data); ++i )
+        data[i] = i * 13;
+
+    for ( u32 i = 0; i < ARRAY_SIZE(parts); ++i )
+    {
+        if ( parts[i].family != TPM20 )
+            continue;
+
+        for ( u32 s = 0; s < ARRAY_SIZE(sizes); ++s )
+        {
+            u8 sha1[SHA1_SIZE], sha256[SHA256_SIZE], want[SHA256_SIZE];
+            struct tpm_pcr_digest d[] = {
+                { TPM_ALG_SHA1, sha1 },
+                { TPM_ALG_SHA256, sha256 },
+            };
+            struct tpm *t = sim_start(&parts[i]);
+            u32 sum = 0, commands;
+
+            if ( t == NULL )
+                continue;
+
+            for ( u32 j = 0; j < sizes[s]; ++j )
+                sum += data[j];
+
+            if ( t->intf == TPM_TIS )
+            {
+                CHECK(tpm_pcr_event(t, 17, data, sizes[s], d, 2) == -EIO);
+                CHECK(tpm_spill(t, spill, sizeof(spill)) == 0);
+            }
+            else
+                CHECK(tpm_spill(t, spill, sizeof(spill)) == -EINVAL);
+
+            commands = sim.commands;
+            CHECK(tpm_pcr_event(t, 17, data, sizes[s], d, 2) == 0);
+            commands = sim.commands - commands;
+
+            sim_digest(want, TPM_ALG_SHA1, sum);
+            CHECK(memcmp(sha1, want, sizeof(sha1)) == 0);
+            sim_digest(want, TPM_ALG_SHA256, sum);
+            CHECK(memcmp(sha256, want, sizeof(sha256)) == 0);
+
+            /* Start, updates of up to 1k each, and complete */
+            if ( sizes[s] <= TPM2_MAX_EVENT_SIZE )
+                CHECK(commands == 1);
+            else
+                CHECK(commands == 2 + (sizes[s] + TPM2_MAX_DIGEST_BUFFER - 1)
+                                      / TPM2_MAX_DIGEST_BUFFER);
+            CHECK(!sim.seq_open);
+
+            sim_stop(t);
+        }
+    }
+}
+
+/*
+ * Only a failure that leaves the PCR as it was may be retried by hashing in
+ * software, so tpm_pcr_event() tells it apart from a lost response.
+ */
+static void test_pcr_event_failure(void)
+{
+    static u8 data[3000];
+    static u8 spill[TPM_SPILL_SIZE];
+    u8 sha1[SHA1_SIZE];
+    struct tpm_pcr_digest d = { TPM_ALG_SHA1, sha1 };
+
+    for ( u32 i = 0; i < ARRAY_SIZE(parts); ++i )
+    {
+        struct tpm *t;
+
+        if ( parts[i].family != TPM20 )
+            continue;
+
+        t = sim_start(&parts[i]);
+        if ( t == NULL )
+            continue;
+
+        if ( t->intf == TPM_TIS )
+            CHECK(tpm_spill(t, spill, sizeof(spill)) == 0);
+
+        sim.fail_rc = TPM_RC_FAILURE;
+        sim.fail_code = TPM_CC_PCR_EVENT;
+        CHECK(tpm_pcr_event(t, 17, data, 16, &d, 1) == -EAGAIN);
+
+        sim.fail_code = TPM_CC_SEQUENCE_UPDATE;
+        CHECK(tpm_pcr_event(t, 17, data, sizeof(data), &d, 1) == -EAGAIN);
+        CHECK(!sim.seq_open);
+
+        sim.fail_code = TPM_CC_EVENT_SEQUENCE_COMPLETE;
+        CHECK(tpm_pcr_event(t, 17, data, sizeof(data), &d, 1) == -EAGAIN);
+        CHECK(!sim.seq_open);
+
+        /* The TPM may yet extend the PCR, so this is -EIO */
+        sim.fail_code = 0;
+        sim.exec_ns = NEVER;
+        CHECK(tpm_pcr_event(t, 17, data, 16, &d, 1) == -EIO);
+        CHECK(sim.errors == 0);
+    }
+}
+#endif
+
+#ifdef ENABLE_TPM_TRACE
+/* Each command gets a record, and the time spent executing it is there */
+static void test_trace(void)
+{
+    static u32 area[256];
+    struct tpm_trace_ring *ring = (void *)area;
+    u8 sha1[SHA1_SIZE] = { 0 };
+    struct tpm_trace_rec *r;
+    struct tpm *t;
+    u32 count;
+
+    tpm_trace_init(area, sizeof(area));
+    t = sim_start(&parts[0]);
+    if ( t == NULL )
+        return;
+
+    count = ring->count;
+    CHECK(tpm_extend_pcr(t, 17, TPM_ALG_SHA1, sha1) == 0);
+    CHECK(ring->count == count + 1);
+
+    r = &ring->recs[count % ring->nr];
+    CHECK(r->code == get32(sim.cmd + 6));
+    CHECK(r->sent == sim.cmd_len);
+    CHECK(r->received == sim.rsp_len);
+    CHECK(r->rc == 0);
+    CHECK(r->polls > 0);
+    CHECK(r->ticks[TPM_TRACE_EXEC] >= sim.exec_ns);
+
+    /* Whatever a device writes to the ring, SKL's records go where they did */
+    ring->nr = 0;
+    ring->count = 0x7fffffff;
+    CHECK(tpm_extend_pcr(t, 17, TPM_ALG_SHA1, sha1) == 0);
+    CHECK(ring->nr == (sizeof(area) - sizeof(*ring)) / sizeof(*r));
+    CHECK(ring->count == count + 2);
+    CHECK(ring->recs[(count + 1) % ring->nr].code == get32(sim.cmd + 6));
+
+    sim_stop(t);
+}
+#endif
+
+int main(void)
+{
+    for ( u32 i = 0; i < ARRAY_SIZE(parts); ++i )
+        test_extend(&parts[i]);
+
+#if defined(ENABLE_TPM12) && defined(ENABLE_TPM_TIS)
+    test_tpm1_timeouts();
+#endif
+    test_timeouts();
+    test_overlap();
+    test_stream();
+#ifdef ENABLE_TPM_HASH
+    test_pcr_event();
+    test_pcr_event_failure();
+#endif
+#ifdef ENABLE_TPM_TRACE
+    test_trace();
+#endif
+
+    if ( !fail )
+        printf("All ok\n");
+
+    return fail;
+}
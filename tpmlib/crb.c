@@ -8,6 +8,14 @@
 #ifdef LINUX_KERNEL
 
 #include <linux/types.h>
+#include <asm/byteorder.h>
+
+#elif defined LINUX_USERSPACE
+
+#include <endian.h>
+
+#define be32_to_cpu be32toh
+#define be16_to_cpu be16toh
 
 #endif
 
@@ -15,6 +23,7 @@
 #include "tpmbuff.h"
 #include "crb.h"
 #include "tpm_common.h"
+#include "tpm_trace.h"
 
 #define TPM_LOC_STATE		0x0000
 #define TPM_LOC_CTRL		0x0008
@@ -107,28 +116,11 @@ struct tpm_crb_intf_id_ext {
 	};
 } __packed;
 
-/*
- * Durations derived from Table 15 of the PTP but is purely an artifact of this
- * implementation
- */
-
-/* TPM Duration A: 20ms */
-static void duration_a(void)
-{
-	tpm_mdelay(20);
-}
-
-/* TPM Duration B: 750ms */
-static void __maybe_unused duration_b(void)
-{
-	tpm_mdelay(750);
-}
-
-/* TPM Duration C: 1000ms */
-static void __maybe_unused duration_c(void)
-{
-	tpm_mdelay(1000);
-}
+#define CRB_LOC_STS_GRANTED	0x1
+#define CRB_CTRL_REQ_CMD_READY	0x1
+#define CRB_CTRL_REQ_GO_IDLE	0x2
+#define CRB_CTRL_STS_ERROR	0x1
+#define CRB_CTRL_START_BUSY	0x1
 
 static u8 is_idle(void)
 {
@@ -164,14 +156,17 @@ static s8 cmd_ready(void)
 {
 	struct tpm_crb_ctrl_req ctl_req;
 
-	if (is_idle()) {
-		ctl_req.cmd_ready = 1;
-		tpm_write32(ctl_req.val, REGISTER(locality, TPM_CRB_CTRL_REQ));
-		tpm2_timeout_c();
+	if (!is_idle())
+		return 0;
+
+	ctl_req.val = 0;
+	ctl_req.cmd_ready = 1;
+	tpm_write32(ctl_req.val, REGISTER(locality, TPM_CRB_CTRL_REQ));
 
-		if (is_idle())
-			return -1;
-	}
+	/* The TPM clears cmdReady once it has left idle */
+	if (!tpm_wait32(REGISTER(locality, TPM_CRB_CTRL_REQ),
+			CRB_CTRL_REQ_CMD_READY, 0, tpm_timeouts.c) || is_idle())
+		return -1;
 
 	return 0;
 }
@@ -183,17 +178,20 @@ static void go_idle(void)
 	if (is_idle())
 		return;
 
+	ctl_req.val = 0;
 	ctl_req.go_idle = 1;
 	tpm_write32(ctl_req.val, REGISTER(locality, TPM_CRB_CTRL_REQ));
 
-	/* pause to give tpm time to complete the request */
-	tpm2_timeout_c();
+	/* give the tpm time to complete the request, it clears goIdle */
+	tpm_wait32(REGISTER(locality, TPM_CRB_CTRL_REQ), CRB_CTRL_REQ_GO_IDLE, 0,
+		   tpm_timeouts.c);
 }
 
 static void crb_relinquish_locality_internal(u16 l)
 {
 	struct tpm_loc_ctrl loc_ctrl;
 
+	loc_ctrl.val = 0;
 	loc_ctrl.relinquish = 1;
 
 	tpm_write32(loc_ctrl.val, REGISTER(l, TPM_LOC_CTRL));
@@ -203,7 +201,6 @@ u8 crb_request_locality(u8 l)
 {
 	struct tpm_loc_state loc_state;
 	struct tpm_loc_ctrl loc_ctrl;
-	struct tpm_loc_sts loc_sts;
 
 	/* TPM_LOC_STATE is aliased across all localities */
 	loc_state.val = tpm_read8(REGISTER(0, TPM_LOC_STATE));
@@ -214,14 +211,15 @@ u8 crb_request_locality(u8 l)
 			return locality;
 		}
 
-		crb_relinquish_locality_internal(loc_state.loc_assigned);
+		crb_relinquish_locality_internal(loc_state.active_locality);
 	}
 
+	loc_ctrl.val = 0;
 	loc_ctrl.request_access = 1;
 	tpm_write32(loc_ctrl.val, REGISTER(l, TPM_LOC_CTRL));
 
-	loc_sts.val = tpm_read32(REGISTER(l, TPM_LOC_STS));
-	if (loc_sts.granted != 1) {
+	if (!tpm_wait32(REGISTER(l, TPM_LOC_STS), CRB_LOC_STS_GRANTED,
+			CRB_LOC_STS_GRANTED, tpm_timeouts.a)) {
 		locality = TPM_NO_LOCALITY;
 		return locality;
 	}
@@ -240,7 +238,8 @@ static void cancel_send(void)
 {
 	if (is_cmd_exec()) {
 		tpm_write32(1, REGISTER(locality, TPM_CRB_CTRL_CANCEL));
-		timeout_b();
+		tpm_wait32(REGISTER(locality, TPM_CRB_CTRL_START),
+			   CRB_CTRL_START_BUSY, 0, tpm_timeouts.b);
 
 		tpm_write32(0, REGISTER(locality, TPM_CRB_CTRL_CANCEL));
 	}
@@ -248,37 +247,59 @@ static void cancel_send(void)
 
 size_t crb_send(struct tpmbuff *buf)
 {
-	u32 ctrl_start = 1;
+	struct tpm_header *hdr = (struct tpm_header *)buf->head;
 
-	if (is_idle())
+	tpm_trace_start(be32_to_cpu(hdr->code), buf->len);
+
+	if (cmd_ready() < 0)
 		return 0;
 
-	tpm_write32(ctrl_start, REGISTER(locality, TPM_CRB_CTRL_START));
+	tpm_trace_mark(TPM_TRACE_READY);
 
-	/*
-	 * Most command sequences this code is interested with operates with
-	 * 20/750 duration/timeout schedule
-	 */
-	duration_a();
-	ctrl_start = tpm_read32(REGISTER(locality, TPM_CRB_CTRL_START));
-	if (ctrl_start != 0) {
-		timeout_a();
-		ctrl_start = tpm_read32(REGISTER(locality, TPM_CRB_CTRL_START));
-		if (ctrl_start != 0) {
-			cancel_send();
-			/* minimum response is header with cancel ord */
-			return sizeof(struct tpm_header);
-		}
-	}
+	/* The TPM runs the command while crb_recv() waits for it */
+	tpm_write32(1, REGISTER(locality, TPM_CRB_CTRL_START));
 
 	return buf->len;
 }
 
 size_t crb_recv(__attribute__((unused)) enum tpm_family family,
-		__attribute__((unused)) struct tpmbuff *buf)
+		struct tpmbuff *buf)
 {
-	/* noop, currently send waits until execution is complete*/
-	return 0;
+	struct tpm_header *hdr = (struct tpm_header *)buf->head;
+	u32 size;
+	u8 done;
+
+	/* The TPM clears CTRL_START once execution is complete */
+	done = tpm_wait32(REGISTER(locality, TPM_CRB_CTRL_START),
+			  CRB_CTRL_START_BUSY, 0, TPM_CMD_TIMEOUT);
+	tpm_trace_mark(TPM_TRACE_EXEC);
+	if (!done) {
+		cancel_send();
+		return 0;
+	}
+
+	/* tpmSts flags a fatal error, with no response to read */
+	if (tpm_read32(REGISTER(locality, TPM_CRB_CTRL_STS)) & CRB_CTRL_STS_ERROR)
+		return 0;
+
+	/*
+	 * The response is already in the data buffer the tpmbuff maps.  Check
+	 * it fits where the TPM says responses go, then account for it and
+	 * convert the header, as tis_recv() does.
+	 */
+	size = be32_to_cpu(hdr->size);
+	if (size < sizeof(struct tpm_header) || size > buf->truesize ||
+	    size > tpm_read32(REGISTER(locality, TPM_CRB_CTRL_RSP_SIZE)))
+		return 0;
+
+	hdr->tag = be16_to_cpu(hdr->tag);
+	hdr->size = size;
+	hdr->code = be32_to_cpu(hdr->code);
+
+	if (!tpmb_put(buf, size - sizeof(struct tpm_header)))
+		return 0;
+
+	return size;
 }
 
 u8 crb_init(struct tpm *t)
@@ -298,10 +319,12 @@ u8 crb_init(struct tpm *t)
 	/* now move to ready state */
 	cmd_ready();
 
+#ifndef TPM_FIXED_INTF
 	t->ops.request_locality = crb_request_locality;
 	t->ops.relinquish_locality = crb_relinquish_locality;
 	t->ops.send = crb_send;
 	t->ops.recv = crb_recv;
+#endif
 
 	return 1;
 }
@@ -25,4 +25,10 @@
 
 u8 crb_init(struct tpm *t);
 
+/* The struct tpm_hw_ops, called directly when CRB is the only interface */
+u8 crb_request_locality(u8 l);
+void crb_relinquish_locality(void);
+size_t crb_send(struct tpmbuff *buf);
+size_t crb_recv(enum tpm_family family, struct tpmbuff *buf);
+
 #endif
@@ -23,29 +23,87 @@
 
 #endif
 
+#include <string.h>
+
 #include "tpm.h"
 #include "tpmbuff.h"
 #include "tpm_common.h"
+#include "tpm_trace.h"
 #include "tis.h"
 
-#define TPM_BURST_MIN_DELAY 100 /* 100us */
-
 static u8 locality = TPM_NO_LOCALITY;
 
+/* Whether the FIFO may be accessed 4 bytes at a time */
+static u8 fifo_wide;
+
+/*
+ * The TIS is driven as a state machine, polling STS and ACCESS.  Each state
+ * change has a deadline from the TIS/PTP timeouts, and a missed deadline
+ * fails the operation rather than waiting forever or for the worst case.
+ */
+
+/* Wait for a non-zero burstCount, returning 0 on timeout */
 static u32 burst_wait(void)
 {
-	u32 count = 0;
+	u64 deadline = tpm_deadline(tpm_timeouts.d);
+	u32 count;
 
-	while (count == 0) {
-		count = tpm_read8(STS(locality) + 1);
-		count += tpm_read8(STS(locality) + 2) << 8;
+	for (;;) {
+		/* burstCount is bytes 1 and 2 of STS, so read it in one go */
+		count = (tpm_read32(STS(locality)) >> 8) & 0xFFFF;
+		if (count != 0 || tpm_expired(deadline))
+			return count;
 
-		/* Wait for FIFO to drain */
-		if (count == 0)
-			tpm_udelay(TPM_BURST_MIN_DELAY);
+		cpu_relax();
 	}
+}
+
+/* Wait for STS to be valid and return it, or 0 on timeout */
+static u8 sts_valid(void)
+{
+	u64 deadline = tpm_deadline(tpm_timeouts.c);
+	u8 status;
+
+	for (;;) {
+		status = tpm_read8(STS(locality));
+		if (status & STS_VALID)
+			return status;
+
+		if (tpm_expired(deadline))
+			return 0;
 
-	return count;
+		cpu_relax();
+	}
+}
+
+/*
+ * Move one burst's worth of data through the FIFO.  The status reads
+ * between bursts are fenced, so the accesses within one need not be.
+ */
+static void fifo_write(const u8 *buf, u32 len)
+{
+	u32 val;
+
+	for (; fifo_wide && len >= 4; buf += 4, len -= 4) {
+		memcpy(&val, buf, 4);
+		tpm_write32_relaxed(val, DATA_FIFO(locality));
+	}
+
+	for (; len > 0; buf++, len--)
+		tpm_write8_relaxed(*buf, DATA_FIFO(locality));
+}
+
+static void fifo_read(u8 *buf, u32 len)
+{
+	u32 val;
+
+	for (; fifo_wide && len >= 4; buf += 4, len -= 4) {
+		val = tpm_read32_relaxed(DATA_FIFO(locality));
+		memcpy(buf, &val, 4);
+	}
+
+	for (; len > 0; buf++, len--)
+		*buf = tpm_read8_relaxed(DATA_FIFO(locality));
 }
 
 void tis_relinquish_locality(void)
@@ -69,100 +127,125 @@ u8 tis_request_locality(u8 l)
 	tpm_write8(ACCESS_REQUEST_USE, ACCESS(l));
 
 	/* wait for locality to be granted */
-	if (tpm_read8(ACCESS(l)) & ACCESS_ACTIVE_LOCALITY)
+	if (tpm_wait8(ACCESS(l), ACCESS_VALID | ACCESS_ACTIVE_LOCALITY,
+		      ACCESS_VALID | ACCESS_ACTIVE_LOCALITY, tpm_timeouts.a))
 		locality = l;
 
 	return locality;
 }
 
-size_t tis_send(struct tpmbuff *buf)
+u8 tis_flush(struct tpmbuff *b, u8 last)
 {
-	u8 status, *buf_ptr;
+	struct tpm_header *hdr = (struct tpm_header *)b->head;
+	u8 status, *buf_ptr = b->head;
 	u32 burstcnt = 0;
-	u32 count = 0;
+	u32 count = b->len;
 
 	if (locality > TPM_MAX_LOCALITY)
 		return 0;
 
-	for (status = 0; (status & STS_COMMAND_READY) == 0; ) {
-		tpm_write8(STS_COMMAND_READY, STS(locality));
-		status = tpm_read8(STS(locality));
-	}
+	/* idle or completion to ready, before the start of a command */
+	if (b->sent == 0) {
+		tpm_trace_start(be32_to_cpu(hdr->code), be32_to_cpu(hdr->size));
+
+		if ((tpm_read8(STS(locality)) & STS_COMMAND_READY) == 0) {
+			tpm_write8(STS_COMMAND_READY, STS(locality));
+			if (!tpm_wait8(STS(locality), STS_COMMAND_READY,
+				       STS_COMMAND_READY, tpm_timeouts.b))
+				return 0;
+		}
 
-	buf_ptr = buf->head;
+		tpm_trace_mark(TPM_TRACE_READY);
+	}
 
-	/* send all but the last byte */
-	while (count < (buf->len - 1)) {
+	while (count > 0) {
 		burstcnt = burst_wait();
-		for (; burstcnt > 0 && count < (buf->len - 1); burstcnt--) {
-			tpm_write8(buf_ptr[count], DATA_FIFO(locality));
-			count++;
-		}
+		if (burstcnt == 0)
+			return 0;
 
-		/* check for overflow */
-		for (status = 0; (status & STS_VALID) == 0; )
-			status = tpm_read8(STS(locality));
+		if (burstcnt > count)
+			burstcnt = count;
 
-		if ((status & STS_DATA_EXPECT) == 0)
+		fifo_write(buf_ptr, burstcnt);
+		buf_ptr += burstcnt;
+		count -= burstcnt;
+
+		/*
+		 * The TPM expects more until it has the whole command, which
+		 * also catches any overflow.
+		 */
+		status = sts_valid();
+		if (status == 0)
+			return 0;
+		if ((status & STS_DATA_EXPECT) ? last && count == 0
+					       : !last || count != 0)
 			return 0;
 	}
 
-	/* write last byte */
-	tpm_write8(buf_ptr[buf->len - 1], DATA_FIFO(locality));
-	count++;
+	b->sent += b->len;
+	b->len = 0;
+	b->tail = b->head;
 
-	/* make sure it stuck */
-	for (status = 0; (status & STS_VALID) == 0; )
-		status = tpm_read8(STS(locality));
+	return 1;
+}
+
+size_t tis_send(struct tpmbuff *buf)
+{
+	size_t size = tpmb_size(buf);
 
-	if ((status & STS_DATA_EXPECT) != 0)
+	if (!tis_flush(buf, 1))
 		return 0;
 
+	/* The response is received into the buffer, as usual */
+	buf->stream = 0;
+	buf->sent = 0;
+
 	/* go and do it */
 	tpm_write8(STS_GO, STS(locality));
 
-	return (size_t)count;
+	return size;
 }
 
 static size_t recv_data(unsigned char *buf, size_t len)
 {
 	size_t size = 0;
-	u8 *bufptr;
 	u32 burstcnt = 0;
 
-	bufptr = (u8 *)buf;
+	while (size < len) {
+		if (!tpm_wait8(STS(locality), STS_VALID | STS_DATA_AVAIL,
+			       STS_VALID | STS_DATA_AVAIL, tpm_timeouts.c))
+			break;
 
-	while (tis_data_available(locality) && size < len) {
 		burstcnt = burst_wait();
-		for (; burstcnt > 0 && size < len; burstcnt--) {
-			*bufptr = tpm_read8(DATA_FIFO(locality));
-			bufptr++;
-			size++;
-		}
+		if (burstcnt == 0)
+			break;
+
+		if (burstcnt > len - size)
+			burstcnt = len - size;
+
+		fifo_read(buf + size, burstcnt);
+		size += burstcnt;
 	}
 
 	return size;
 }
 
-size_t tis_recv(enum tpm_family f, struct tpmbuff *buf)
+size_t tis_recv(__attribute__((unused)) enum tpm_family f,
+		struct tpmbuff *buf)
 {
 	u32 expected;
-	u8 *buf_ptr;
+	u8 status, *buf_ptr;
 	struct tpm_header *hdr;
 
 	if (locality > TPM_MAX_LOCALITY)
 		return 0;
 
-	/* ensure that there is data available */
-	if (!tis_data_available(locality)) {
-		if (f == TPM12)
-			tpm1_timeout_d();
-		else
-			tpm2_timeout_d();
-
-		if (!tis_data_available(locality))
-			return 0;
-	}
+	/* wait for execution to complete, and the response to be there */
+	status = tpm_wait8(STS(locality), STS_VALID | STS_DATA_AVAIL,
+			   STS_VALID | STS_DATA_AVAIL, TPM_CMD_TIMEOUT);
+	tpm_trace_mark(TPM_TRACE_EXEC);
+	if (!status)
+		return 0;
 
 	/* read header */
 	hdr = (struct tpm_header *)buf->head;
@@ -176,7 +259,7 @@ size_t tis_recv(enum tpm_family f, struct tpmbuff *buf)
 	hdr->code = be32_to_cpu(hdr->code);
 
 	/* protect against integer underflow */
-	if (hdr->size <= expected)
+	if (hdr->size < expected)
 		return 0;
 
 	/* hdr->size = header + data */
@@ -185,20 +268,12 @@ size_t tis_recv(enum tpm_family f, struct tpmbuff *buf)
 	if (!buf_ptr)
 		return 0;
 
-	/* read all data, except last byte */
-	if (recv_data(buf_ptr, expected - 1) < (expected - 1))
-		return 0;
-
-	/* check for receive underflow */
-	if (!tis_data_available(locality))
-		return 0;
-
-	/* read last byte */
-	if (recv_data(buf_ptr, 1) != 1)
+	if (recv_data(buf_ptr, expected) < expected)
 		return 0;
 
 	/* make sure we read everything */
-	if (tis_data_available(locality))
+	status = sts_valid();
+	if (status == 0 || (status & STS_DATA_AVAIL) != 0)
 		return 0;
 
 	tpm_write8(STS_COMMAND_READY, STS(locality));
@@ -208,8 +283,17 @@ size_t tis_recv(enum tpm_family f, struct tpmbuff *buf)
 
 u8 tis_init(struct tpm *t)
 {
+	struct tpm_intf_capability intf_cap;
+
 	locality = TPM_NO_LOCALITY;
 
+	/*
+	 * Only TPMs doing legacy (single byte) transfers need byte accesses to
+	 * the FIFO.  The field is reserved, so 0, in TIS 1.2 parts.
+	 */
+	intf_cap.val = tpm_read32(TPM_INTF_CAPABILITY_0);
+	fifo_wide = intf_cap.data_transfer_size_support != 0;
+
 	if (tis_request_locality(0) != 0)
 		return 0;
 
@@ -217,10 +301,12 @@ u8 tis_init(struct tpm *t)
 	if ((t->vendor & 0xFFFF) == 0xFFFF)
 		return 0;
 
+#ifndef TPM_FIXED_INTF
 	t->ops.request_locality = tis_request_locality;
 	t->ops.relinquish_locality = tis_relinquish_locality;
 	t->ops.send = tis_send;
 	t->ops.recv = tis_recv;
+#endif
 
 	return 1;
 }
@@ -27,6 +27,7 @@
 #define DATA_FIFO(l)			(0x0024 | ((l) << 12))
 #define DID_VID(l)			(0x0F00 | ((l) << 12))
 /* access bits */
+#define ACCESS_VALID			0x80 /* (R) */
 #define ACCESS_ACTIVE_LOCALITY		0x20 /* (R)*/
 #define ACCESS_RELINQUISH_LOCALITY	0x20 /* (W) */
 #define ACCESS_REQUEST_USE		0x02 /* (W) */
@@ -37,15 +38,20 @@
 #define STS_DATA_EXPECT			0x08 /* (R) */
 #define STS_GO				0x20 /* (W) */
 
-static inline bool tis_data_available(int locality)
-{
-	int status;
-
-	status = tpm_read8(STS(locality));
-	return ((status & (STS_DATA_AVAIL | STS_VALID)) ==
-		(STS_DATA_AVAIL | STS_VALID));
-}
+struct tpmbuff;
 
 u8 tis_init(struct tpm *t);
 
+/* The struct tpm_hw_ops, called directly when TIS is the only interface */
+u8 tis_request_locality(u8 l);
+void tis_relinquish_locality(void);
+size_t tis_send(struct tpmbuff *buf);
+size_t tis_recv(enum tpm_family f, struct tpmbuff *buf);
+
+/*
+ * Send what the buffer holds on to the FIFO, leaving it empty.  last says
+ * this ends the command.  Returns 0 on failure.
+ */
+u8 tis_flush(struct tpmbuff *b, u8 last);
+
 #endif
@@ -18,6 +18,8 @@
 #include <string.h>
 #include <errno.h>
 
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
 #endif
 
 #include <string.h>
@@ -27,17 +29,49 @@
 #include "tis.h"
 #include "crb.h"
 #include "tpm_common.h"
+#include "tpm_trace.h"
 #include "tpm1.h"
 #include "tpm2.h"
+#include "tpm2_auth.h"
 #include "tpm2_constants.h"
 
 static struct tpm tpm;
 
+struct tpm_timeouts tpm_timeouts;
+
+static const struct tpm_timeouts tpm1_timeouts = {
+	TIMEOUT_A, TIMEOUT_B, TPM1_TIMEOUT_C, TPM1_TIMEOUT_D, DURATION_A
+};
+
+static const struct tpm_timeouts tpm2_timeouts = {
+	TIMEOUT_A, TIMEOUT_B, TPM2_TIMEOUT_C, TPM2_TIMEOUT_D, DURATION_A
+};
+
+/*
+ * Parts which report TIS timeouts A-D they don't keep to, by t->vendor, with
+ * the values to use instead.  As in Linux, the durations they report stand.
+ */
+static const struct {
+	u32 vendor;
+	u32 a, b, c, d;
+} timeout_quirks[] = {
+	/* Atmel 3204 */
+	{ 0x32041114, TIMEOUT_A, TIMEOUT_B, TPM1_TIMEOUT_C, TPM1_TIMEOUT_D },
+};
+
+/* Only what is built in needs to be asked of the TPM */
 static void find_interface_and_family(struct tpm *t)
 {
-	struct tpm_interface_id intf_id;
+#ifndef TPM_FIXED_FAMILY
 	struct tpm_intf_capability intf_cap;
+#endif
+#ifndef TPM_FIXED_INTF
+	struct tpm_interface_id intf_id;
+#endif
 
+#ifdef TPM_FIXED_FAMILY
+	t->family = TPM_FIXED_FAMILY;
+#else
 	/* Sort out whether if it is 1.2 */
 	intf_cap.val = tpm_read32(TPM_INTF_CAPABILITY_0);
 	if ((intf_cap.interface_version == TPM12_TIS_INTF_12) ||
@@ -47,14 +81,45 @@ static void find_interface_and_family(struct tpm *t)
 		return;
 	}
 
-	/* Assume that it is 2.0 and TIS */
+	/* Assume that it is 2.0 */
 	t->family = TPM20;
-	t->intf = TPM_TIS;
+#endif
 
-	/* Check if the interface is CRB */
+#ifdef TPM_FIXED_INTF
+	t->intf = TPM_FIXED_INTF;
+#else
+	/* and TIS, unless the interface is CRB */
+	t->intf = TPM_TIS;
 	intf_id.val = tpm_read32(TPM_INTERFACE_ID_0);
 	if (intf_id.interface_type == TPM_CRB_INTF_ACTIVE)
 		t->intf = TPM_CRB;
+#endif
+}
+
+/*
+ * A TPM 1.2 reports its own timeouts and durations.  Those of a TPM 2.0 are
+ * fixed by the PTP, which has nothing like TPM_CAP_PROP_TIS_TIMEOUT.
+ */
+static void tpm_read_timeouts(struct tpm *t)
+{
+	u32 i;
+
+	if (tpm_family(t) == TPM12) {
+		/* The *_init() functions leave locality 0 active */
+		t->buff = alloc_tpmbuff(tpm_intf(t), 0);
+		if (t->buff)
+			tpm1_get_timeouts(t, &tpm_timeouts);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(timeout_quirks); i++) {
+		if (timeout_quirks[i].vendor != t->vendor)
+			continue;
+
+		tpm_timeouts.a = timeout_quirks[i].a;
+		tpm_timeouts.b = timeout_quirks[i].b;
+		tpm_timeouts.c = timeout_quirks[i].c;
+		tpm_timeouts.d = timeout_quirks[i].d;
+	}
 }
 
 struct tpm *enable_tpm(void)
@@ -65,7 +130,9 @@ struct tpm *enable_tpm(void)
 
 	find_interface_and_family(t);
 
-	switch (t->intf) {
+	tpm_timeouts = tpm_family(t) == TPM12 ? tpm1_timeouts : tpm2_timeouts;
+
+	switch (tpm_intf(t)) {
 	case TPM_TIS:
 		if (!tis_init(t))
 			return NULL;
@@ -76,82 +143,251 @@ struct tpm *enable_tpm(void)
 		break;
 	}
 
+	tpm_read_timeouts(t);
+	tpm_trace_tpm(t);
+
 	return t;
 }
 
+static void tpm_sync(struct tpm *t);
+
 u8 tpm_request_locality(struct tpm *t, u8 l)
 {
 	u8 ret = TPM_NO_LOCALITY;
 
-	ret = t->ops.request_locality(l);
+	tpm_sync(t);
+
+	tpm_trace_start(TPM_TRACE_LOCALITY | l, 0);
+	ret = tpm_hw_op(t, request_locality)(l);
+	tpm_trace_mark(TPM_TRACE_READY);
+	tpm_trace_end(0, ret);
 
 	if (ret < TPM_MAX_LOCALITY)
-		t->buff = alloc_tpmbuff(t->intf, ret);
+		t->buff = alloc_tpmbuff(tpm_intf(t), ret);
 
 	return ret;
 }
 
 void tpm_relinquish_locality(struct tpm *t)
 {
-	t->ops.relinquish_locality();
+	tpm_sync(t);
 
-	free_tpmbuff(t->buff, t->intf);
+	tpm_trace_start(TPM_TRACE_RELINQUISH, 0);
+	tpm_hw_op(t, relinquish_locality)();
+	tpm_trace_mark(TPM_TRACE_READY);
+	tpm_trace_end(0, 0);
+
+	free_tpmbuff(t->buff, tpm_intf(t));
 }
 
-#define MAX_TPM_EXTEND_SIZE 70 /* TPM2 SHA512 is the largest */
-int tpm_extend_pcr(struct tpm *t, u32 pcr, u16 algo,
-		u8 *digest)
+int tpm_submit(struct tpm *t)
+{
+	struct tpmbuff *b = t->buff;
+	size_t size = tpmb_size(b);
+	size_t sent = tpm_hw_op(t, send)(b);
+
+	tpm_trace_mark(TPM_TRACE_SEND);
+	if (sent != size) {
+		tpm_trace_end(0, TPM_TRACE_FAILED);
+		/* crb_send() also waits for execution, which may have begun */
+		return tpm_intf(t) == TPM_CRB ? -EIO : -EAGAIN;
+	}
+
+	t->pending = 1;
+
+	return 0;
+}
+
+/* Receive the response to the command in flight */
+static int tpm_receive(struct tpm *t)
+{
+	struct tpmbuff *b = t->buff;
+	struct tpm_header *hdr;
+	size_t size;
+
+	t->pending = 0;
+	tpm_trace_mark(TPM_TRACE_OVERLAP);
+
+	/* Reset buffer for receive */
+	hdr = (struct tpm_header *)b->head;
+	tpmb_trim(b, tpmb_size(b));
+	tpmb_put(b, sizeof(struct tpm_header));
+
+	/* recv() will increase the buffer size */
+	size = tpm_hw_op(t, recv)(tpm_family(t), b);
+	tpm_trace_mark(TPM_TRACE_RECV);
+	tpm_trace_end(size, size ? hdr->code : TPM_TRACE_FAILED);
+	if (size == 0 || tpmb_size(b) != size)
+		return -EIO;
+
+	/* TPM_SUCCESS and TPM_RC_SUCCESS are both 0 */
+	if (hdr->code != 0)
+		return -EAGAIN;
+
+	return 0;
+}
+
+/*
+ * Wait for an extend tpm_extend_pcr_submit() left running, so the TPM can
+ * take another command.  The first failure is kept for tpm_complete().
+ */
+static void tpm_sync(struct tpm *t)
+{
+	int ret;
+
+	if (!t->pending)
+		return;
+
+	ret = tpm_receive(t);
+	if (t->status == 0)
+		t->status = ret;
+}
+
+int tpm_complete(struct tpm *t)
+{
+	int ret;
+
+	tpm_sync(t);
+
+	ret = t->status;
+	t->status = 0;
+
+	return ret;
+}
+
+int tpm_transmit(struct tpm *t)
+{
+	int ret = tpm_submit(t);
+
+	if (ret < 0)
+		return ret;
+
+	return tpm_receive(t);
+}
+
+u16 tpm_digest_size(u16 alg)
+{
+	switch (alg) {
+	case TPM_ALG_SHA1:
+		return SHA1_SIZE;
+	case TPM_ALG_SHA256:
+		return SHA256_SIZE;
+	case TPM_ALG_SHA384:
+		return SHA384_SIZE;
+	case TPM_ALG_SHA512:
+		return SHA512_SIZE;
+	case TPM_ALG_SM3_256:
+		return SM3256_SIZE;
+	default:
+		return 0;
+	}
+}
+
+u32 tpm_pcr_banks(struct tpm *t)
+{
+	if (t->banks != 0)
+		return t->banks;
+
+	tpm_sync(t);
+
+	/*
+	 * Should a TPM2 not answer, assume the SHA1 and SHA256 banks that were
+	 * always extended before the banks were asked for.
+	 */
+	if (tpm_family(t) == TPM12)
+		t->banks = TPM_BANK(TPM_ALG_SHA1);
+	else if (tpm2_get_pcr_banks(t, &t->banks) < 0 || t->banks == 0)
+		t->banks = TPM_BANK(TPM_ALG_SHA1) | TPM_BANK(TPM_ALG_SHA256);
+
+	return t->banks;
+}
+
+int tpm_extend_pcr_submit(struct tpm *t, u32 pcr,
+		struct tpm_pcr_digest *digests, u32 count)
 {
 	int ret = 0;
 
-	if (t->buff == NULL)
+	if (t->buff == NULL || count == 0)
 		return -EINVAL;
 
-	if (t->family == TPM12) {
+	/* The TPM runs one command at a time */
+	tpm_sync(t);
+
+	if (tpm_family(t) == TPM12) {
 		struct tpm_digest d;
 
-		if (algo != TPM_ALG_SHA1)
+		/* TPM 1.2 has just the one bank */
+		if (count != 1 || digests->alg != TPM_ALG_SHA1)
 			return -EINVAL;
 
 		d.pcr = pcr;
 		memcpy((void *)d.digest.sha1.digest,
-			digest, SHA1_DIGEST_SIZE);
+			digests->digest, SHA1_DIGEST_SIZE);
 
 		ret = tpm1_pcr_extend(t, &d);
-	} else if (t->family == TPM20) {
-		struct tpml_digest_values *d;
-		u8 buf[MAX_TPM_EXTEND_SIZE];
-
-		d = (struct tpml_digest_values *) buf;
-		d->count = 1;
-		d->digests->alg = algo;
-		switch (algo) {
-		case TPM_ALG_SHA1:
-			memcpy(d->digests->digest, digest, SHA1_SIZE);
-			break;
-		case TPM_ALG_SHA256:
-			memcpy(d->digests->digest, digest, SHA256_SIZE);
-			break;
-		case TPM_ALG_SHA384:
-			memcpy(d->digests->digest, digest, SHA384_SIZE);
-			break;
-		case TPM_ALG_SHA512:
-			memcpy(d->digests->digest, digest, SHA512_SIZE);
-			break;
-		case TPM_ALG_SM3_256:
-			memcpy(d->digests->digest, digest, SM3256_SIZE);
-			break;
-		default:
-			return -EINVAL;
-		}
-
-		ret = tpm2_extend_pcr(t, pcr, d);
+	} else if (tpm_family(t) == TPM20) {
+		ret = tpm2_extend_pcr(t, pcr, digests, count);
 	} else
 		ret = -EINVAL;
 
 	return ret;
 }
 
+#ifdef ENABLE_TPM_HASH
+u32 tpm_event_max(struct tpm *t)
+{
+	/*
+	 * header, pcrHandle, authorizationSize, a NULL auth and event.size,
+	 * unless the command is streamed, whatever the buffer's size.
+	 */
+	u32 room = t->buff->fifo ? TPM2_MAX_EVENT_SIZE :
+		t->buff->truesize - sizeof(struct tpm_header) -
+		2 * sizeof(u32) - tpm2_null_auth_size() - sizeof(u16);
+
+	return room < TPM2_MAX_EVENT_SIZE ? room : TPM2_MAX_EVENT_SIZE;
+}
+
+int tpm_spill(struct tpm *t, void *area, u32 size)
+{
+	if (t->buff == NULL)
+		return -EINVAL;
+
+	tpm_sync(t);
+
+	return tpmb_spill(t->buff, area, size);
+}
+
+int tpm_pcr_event(struct tpm *t, u32 pcr, const void *data, u32 size,
+		struct tpm_pcr_digest *digests, u32 count)
+{
+	if (t->buff == NULL || tpm_family(t) != TPM20)
+		return -EINVAL;
+
+	tpm_sync(t);
+
+	return tpm2_pcr_event(t, pcr, data, size, digests, count);
+}
+#endif /* ENABLE_TPM_HASH */
+
+int tpm_extend_pcr_digests(struct tpm *t, u32 pcr,
+		struct tpm_pcr_digest *digests, u32 count)
+{
+	int ret = tpm_extend_pcr_submit(t, pcr, digests, count);
+
+	if (ret < 0)
+		return ret;
+
+	return tpm_complete(t);
+}
+
+int tpm_extend_pcr(struct tpm *t, u32 pcr, u16 algo,
+		u8 *digest)
+{
+	struct tpm_pcr_digest d = { algo, digest };
+
+	return tpm_extend_pcr_digests(t, pcr, &d, 1);
+}
+
 void free_tpm(struct tpm *t)
 {
 	tpm_relinquish_locality(t);
@@ -19,6 +19,8 @@
 #define u16 uint16_t
 #define u32 uint32_t
 #define u64 uint64_t
+#define s8 int8_t
+#define s64 int64_t
 
 #endif
 
@@ -43,18 +45,111 @@ struct tpm_hw_ops {
 	size_t (*recv)(enum tpm_family family, struct tpmbuff *buf);
 };
 
+/*
+ * The families and interfaces to support, from SKL's TPM make option, and by
+ * default all of them.  With only one family or interface, tpm_family() and
+ * tpm_intf() are constants, so code for the others drops out, and the
+ * interface is called directly instead of through t->ops.
+ */
+#if !defined(ENABLE_TPM12) && !defined(ENABLE_TPM20)
+#define ENABLE_TPM12
+#define ENABLE_TPM20
+#endif
+
+#if !defined(ENABLE_TPM_TIS) && !defined(ENABLE_TPM_CRB)
+#define ENABLE_TPM_TIS
+#define ENABLE_TPM_CRB
+#endif
+
+#ifndef ENABLE_TPM20
+#define TPM_FIXED_FAMILY	TPM12
+#elif !defined(ENABLE_TPM12)
+#define TPM_FIXED_FAMILY	TPM20
+#endif
+
+#ifndef ENABLE_TPM_CRB
+#define TPM_FIXED_INTF		TPM_TIS
+#elif !defined(ENABLE_TPM_TIS)
+#define TPM_FIXED_INTF		TPM_CRB
+#endif
+
+#ifdef TPM_FIXED_FAMILY
+#define tpm_family(t)		TPM_FIXED_FAMILY
+#else
+#define tpm_family(t)		((t)->family)
+#endif
+
+#ifndef TPM_FIXED_INTF
+#define tpm_intf(t)		((t)->intf)
+#define tpm_hw_op(t, op)	((t)->ops.op)
+#elif defined(ENABLE_TPM_TIS)
+#define tpm_intf(t)		TPM_TIS
+#define tpm_hw_op(t, op)	tis_##op
+#else
+#define tpm_intf(t)		TPM_CRB
+#define tpm_hw_op(t, op)	crb_##op
+#endif
+
 struct tpm {
 	u32 vendor;
 	enum tpm_family family;
 	enum tpm_hw_intf intf;
 	struct tpm_hw_ops ops;
 	struct tpmbuff *buff;
+	u32 banks;		/* Cached by tpm_pcr_banks() */
+	u8 pending;		/* A command is executing, see tpm_complete() */
+	int status;		/* Of the extends tpm_complete() hasn't returned */
 };
 
+/* All TPM_ALG_* hash IDs are below 32, so a bank set fits in a u32 */
+#define TPM_BANK(alg)		(1U << (alg))
+
 extern struct tpm *enable_tpm(void);
 extern u8 tpm_request_locality(struct tpm *t, u8 l);
 extern void tpm_relinquish_locality(struct tpm *t);
+/* One bank's digest, for tpm_extend_pcr_digests() */
+struct tpm_pcr_digest {
+	u16 alg;
+	u8 *digest;
+};
+
 extern int tpm_extend_pcr(struct tpm *t, u32 pcr, u16 algo,
 		u8 *digest);
+/* Digest size of a TPM_ALG_*, or 0 if it isn't a supported bank */
+extern u16 tpm_digest_size(u16 alg);
+/* The PCR banks allocated in the TPM, read from it on first use */
+extern u32 tpm_pcr_banks(struct tpm *t);
+/* Extend several banks of a TPM2 PCR with a single command */
+extern int tpm_extend_pcr_digests(struct tpm *t, u32 pcr,
+		struct tpm_pcr_digest *digests, u32 count);
+/*
+ * As tpm_extend_pcr_digests(), but return once a TPM2 has the command, which
+ * leaves the CPU free while it executes.  Any later call into tpmlib first
+ * waits for it to finish.  tpm_complete() does so explicitly, and returns
+ * the result of every extend submitted since it was last called: 0, or the
+ * first failure.  TPM 1.2 extends still complete before returning.
+ */
+extern int tpm_extend_pcr_submit(struct tpm *t, u32 pcr,
+		struct tpm_pcr_digest *digests, u32 count);
+extern int tpm_complete(struct tpm *t);
+/*
+ * Have a TPM2 hash data itself and extend the result into every allocated
+ * bank of pcr.  The digests of any of the count digests' algs the TPM has
+ * are copied back, for the event log.  Data of up to tpm_event_max() bytes
+ * takes a single TPM2_PCR_Event, anything more a hash sequence.  Only
+ * built with ENABLE_TPM_HASH.  -EIO means the PCR may have been extended,
+ * but the digests were lost; any other failure leaves the PCR unchanged.
+ */
+extern int tpm_pcr_event(struct tpm *t, u32 pcr, const void *data, u32 size,
+		struct tpm_pcr_digest *digests, u32 count);
+extern u32 tpm_event_max(struct tpm *t);
+/*
+ * Responses to TPM2_PCR_Event of more than two banks don't fit a TIS buffer.
+ * Give the TPM area, outside the SLB, to receive them in; see tpmb_spill().
+ * Only built with ENABLE_TPM_HASH, and fails for a CRB TPM, which needs no
+ * area.
+ */
+#define TPM_SPILL_SIZE		256
+extern int tpm_spill(struct tpm *t, void *area, u32 size);
 extern void free_tpm(struct tpm *t);
 #endif
@@ -71,6 +71,12 @@
 
 /* Section 17 */
 #define TPM_ORD_EXTEND			0x00000014
+#define TPM_ORD_GET_CAPABILITY		0x00000065
+
+/* Section 21 */
+#define TPM_CAP_PROPERTY		0x00000005
+#define TPM_CAP_PROP_TIS_TIMEOUT	0x00000115
+#define TPM_CAP_PROP_DURATION		0x00000120
 
 #define SHA1_DIGEST_SIZE 20
 
@@ -105,7 +111,14 @@ struct tpm_extend_resp {
 	TPM_PCRVALUE digest;
 };
 
+struct tpm_timeouts;
+
 /* TPM Commands */
 int tpm1_pcr_extend(struct tpm *t, struct tpm_digest *d);
+/*
+ * Update to with the TIS timeouts and the short duration the TPM reports,
+ * keeping the current value of any it reports as 0.
+ */
+int tpm1_get_timeouts(struct tpm *t, struct tpm_timeouts *to);
 
 #endif
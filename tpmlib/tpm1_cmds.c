@@ -19,8 +19,13 @@
 #elif defined LINUX_USERSPACE
 
 #include <string.h>
+#include <endian.h>
 #include <errno.h>
 
+#define be32_to_cpu be32toh
+#define cpu_to_be16 htobe16
+#define cpu_to_be32 htobe32
+
 #endif
 
 #include <string.h>
@@ -37,7 +42,6 @@ int tpm1_pcr_extend(struct tpm *t, struct tpm_digest *d)
 	struct tpmbuff *b = t->buff;
 	struct tpm_header *hdr;
 	struct tpm_extend_cmd *cmd;
-	size_t size;
 
 	if (b == NULL) {
 		ret = -EINVAL;
@@ -55,6 +59,8 @@ int tpm1_pcr_extend(struct tpm *t, struct tpm_digest *d)
 
 
 	hdr->tag = cpu_to_be16(TPM_TAG_RQU_COMMAND);
+	hdr->size = cpu_to_be32(sizeof(struct tpm_header) +
+			sizeof(struct tpm_extend_cmd));
 	hdr->code = cpu_to_be32(TPM_ORD_EXTEND);
 
 	cmd = (struct tpm_extend_cmd *)
@@ -67,44 +73,100 @@ int tpm1_pcr_extend(struct tpm *t, struct tpm_digest *d)
 	cmd->pcr_num = cpu_to_be32(d->pcr);
 	memcpy(&(cmd->digest), &(d->digest), sizeof(TPM_DIGEST));
 
-	hdr->size = cpu_to_be32(tpmb_size(b));
-
-	if (be32_to_cpu(hdr->size) != t->ops.send(b)) {
-		ret = -EAGAIN;
-		goto free;
-	}
-
-	/* Reset buffer for receive */
-	tpmb_trim(b, tpmb_size(b));
-
-	hdr = (struct tpm_header *)b->head;
-	tpmb_put(b, sizeof(struct tpm_header));
-
 	/*
 	 * The extend receive operation returns a struct tpm_extend_resp
 	 * but the current implementation ignores the returned PCR value.
-	 */
-
-	/* recv() will increase the buffer size */
-	size = t->ops.recv(t->family, b);
-	if (tpmb_size(b) != size) {
-		ret = -EAGAIN;
-		goto free;
-	}
-
-	/*
+	 *
 	 * On return, the code field is used for the return code out. Though
 	 * the commands specifications section 16.1 implies there is an
 	 * ordinal field, the return size and values point to this being
 	 * incorrect.
-	 *
-	 * Also tis_recv() converts the header back to CPU endianness.
 	 */
-	if (hdr->code != TPM_SUCCESS)
-		ret = -EAGAIN;
+	ret = tpm_transmit(t);
 
 free:
 	tpmb_free(b);
 out:
 	return ret;
 }
+
+/* 0 means not reported, and a few parts report milliseconds */
+static u32 tpm1_us(u32 val, u32 cur)
+{
+	if (val == 0)
+		return cur;
+
+	return val < 1000 ? val * 1000 : val;
+}
+
+/*
+ * TPM_GetCapability(TPM_CAP_PROPERTY, prop), updating vals with the first n
+ * u32s of the property.
+ */
+static int tpm1_get_cap_prop(struct tpm *t, u32 prop, u32 *vals, u32 n)
+{
+	int ret = 0;
+	struct tpmbuff *b = t->buff;
+	struct tpm_header *hdr;
+	u32 *p;
+	u32 i;
+
+	/* ensure buffer is free for use */
+	tpmb_free(b);
+
+	hdr = (struct tpm_header *)tpmb_reserve(b);
+	if (!hdr)
+		return -ENOMEM;
+
+	hdr->tag = cpu_to_be16(TPM_TAG_RQU_COMMAND);
+	hdr->size = cpu_to_be32(sizeof(struct tpm_header) + 3 * sizeof(u32));
+	hdr->code = cpu_to_be32(TPM_ORD_GET_CAPABILITY);
+
+	/* capArea, subCapSize and subCap */
+	p = (u32 *)tpmb_put(b, 3 * sizeof(u32));
+	if (p == NULL) {
+		ret = -ENOMEM;
+		goto free;
+	}
+
+	p[0] = cpu_to_be32(TPM_CAP_PROPERTY);
+	p[1] = cpu_to_be32(sizeof(u32));
+	p[2] = cpu_to_be32(prop);
+
+	ret = tpm_transmit(t);
+	if (ret < 0)
+		goto free;
+
+	/* respSize, then the property */
+	p = (u32 *)(b->head + sizeof(struct tpm_header));
+	if (tpmb_size(b) < sizeof(struct tpm_header) + (n + 1) * sizeof(u32)) {
+		ret = -EINVAL;
+		goto free;
+	}
+
+	for (i = 0; i < n; i++)
+		vals[i] = tpm1_us(be32_to_cpu(p[i + 1]), vals[i]);
+
+free:
+	tpmb_free(b);
+	return ret;
+}
+
+int tpm1_get_timeouts(struct tpm *t, struct tpm_timeouts *to)
+{
+	u32 v[4] = { to->a, to->b, to->c, to->d };
+	int ret;
+
+	/* a to d, in the order TPM_CAP_PROP_TIS_TIMEOUT gives them */
+	ret = tpm1_get_cap_prop(t, TPM_CAP_PROP_TIS_TIMEOUT, v, 4);
+	if (ret < 0)
+		return ret;
+
+	to->a = v[0];
+	to->b = v[1];
+	to->c = v[2];
+	to->d = v[3];
+
+	/* Short, medium and long; SKL only sends short commands */
+	return tpm1_get_cap_prop(t, TPM_CAP_PROP_DURATION, &to->duration_a, 1);
+}
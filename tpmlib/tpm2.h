@@ -49,6 +49,22 @@ struct tpml_digest_values {
 };
 
 
+// Table 85  Definition of TPMS_PCR_SELECTION Structure
+struct tpms_pcr_selection {
+	u16 hash;		/* TPMI_ALG_HASH	*/
+	u8 size_of_select;
+	u8 pcr_select[0];
+} __packed;
+
+// Table 106  Definition of TPMS_CAPABILITY_DATA Structure, as returned
+// by TPM2_GetCapability(TPM_CAP_PCRS)
+struct tpm2_cap_pcrs {
+	u8 more_data;		/* TPMI_YES_NO		*/
+	u32 capability;
+	u32 count;		/* TPML_PCR_SELECTION	*/
+	struct tpms_pcr_selection pcrs[0];
+} __packed;
+
 // Table 124  Definition of TPMS_AUTH_COMMAND Structure <  IN>
 struct tpms_auth_cmd {
 	u32 *handle;
@@ -82,7 +98,21 @@ struct tpm2_resp {
 	u8 *raw;		/* internal raw buffer	*/
 };
 
+/* Largest TPM2B_EVENT, and the smallest MAX_DIGEST_BUFFER a TPM may have */
+#define TPM2_MAX_EVENT_SIZE	1024
+#define TPM2_MAX_DIGEST_BUFFER	1024
+
 int tpm2_extend_pcr(struct tpm *t, u32 pcr,
-		struct tpml_digest_values *digests);
+		struct tpm_pcr_digest *digests, u32 count);
+/*
+ * Have the TPM hash data into every allocated bank of pcr, with a single
+ * TPM2_PCR_Event if it fits in t->buff and an event sequence otherwise, and
+ * copy the resulting digests into those of the count digests with a matching
+ * alg.
+ */
+int tpm2_pcr_event(struct tpm *t, u32 pcr, const u8 *data, u32 size,
+		struct tpm_pcr_digest *digests, u32 count);
+/* Mask of the allocated PCR banks, as TPM_BANK(TPM_ALG_*) */
+int tpm2_get_pcr_banks(struct tpm *t, u32 *banks);
 
 #endif
@@ -20,6 +20,8 @@
 #include <endian.h>
 #include <errno.h>
 
+#define be16_to_cpu be16toh
+#define be32_to_cpu be32toh
 #define cpu_to_be16 htobe16
 #define cpu_to_be32 htobe32
 
@@ -35,8 +37,12 @@
 #include "tis.h"
 #include "crb.h"
 
+/*
+ * Start a command of params bytes after the header.  The size is needed up
+ * front, as a TIS command is streamed as it is built.
+ */
 static int tpm2_alloc_cmd(struct tpmbuff *b, struct tpm2_cmd *c, u16 tag,
-		u32 code)
+		u32 code, u32 params)
 {
 	/* ensure buffer is free for use */
 	tpmb_free(b);
@@ -46,60 +52,58 @@ static int tpm2_alloc_cmd(struct tpmbuff *b, struct tpm2_cmd *c, u16 tag,
 		return -ENOMEM;
 
 	c->header->tag = cpu_to_be16(tag);
+	c->header->size = cpu_to_be32(sizeof(struct tpm_header) + params);
 	c->header->code = cpu_to_be32(code);
 
 	return 0;
 }
 
-static u16 convert_digest_list(struct tpml_digest_values *digests)
+/*
+ * As tpm2_alloc_cmd(), for a command with sessions on nr handles, params
+ * being the size after the sessions.  SKL owns no objects with an
+ * authValue, so every handle gets a NULL password auth.
+ */
+static int tpm2_alloc_auth_cmd(struct tpmbuff *b, struct tpm2_cmd *c,
+		u32 code, u32 *handles, u32 nr, u32 params)
 {
-	int i;
-	u16 size = sizeof(digests->count);
-	struct tpmt_ha *h = digests->digests;
-
-	for (i = 0; i < digests->count; i++) {
-		switch (h->alg) {
-		case TPM_ALG_SHA1:
-			h->alg = cpu_to_be16(h->alg);
-			h = (struct tpmt_ha *)((u8 *)h + SHA1_SIZE);
-			size += sizeof(u16) + SHA1_SIZE;
-			break;
-		case TPM_ALG_SHA256:
-			h->alg = cpu_to_be16(h->alg);
-			h = (struct tpmt_ha *)((u8 *)h + SHA256_SIZE);
-			size += sizeof(u16) + SHA256_SIZE;
-			break;
-		case TPM_ALG_SHA384:
-			h->alg = cpu_to_be16(h->alg);
-			h = (struct tpmt_ha *)((u8 *)h + SHA384_SIZE);
-			size += sizeof(u16) + SHA384_SIZE;
-			break;
-		case TPM_ALG_SHA512:
-			h->alg = cpu_to_be16(h->alg);
-			h = (struct tpmt_ha *)((u8 *)h + SHA512_SIZE);
-			size += sizeof(u16) + SHA512_SIZE;
-			break;
-		case TPM_ALG_SM3_256:
-			h->alg = cpu_to_be16(h->alg);
-			h = (struct tpmt_ha *)((u8 *)h + SM3256_SIZE);
-			size += sizeof(u16) + SHA1_SIZE;
-			break;
-		default:
-			return 0;
-		}
-	}
+	u32 auth_size = nr * tpm2_null_auth_size();
+	u32 i;
+	int ret;
 
-	digests->count = cpu_to_be32(digests->count);
+	ret = tpm2_alloc_cmd(b, c, TPM_ST_SESSIONS, code,
+			(nr + 1) * sizeof(u32) + auth_size + params);
+	if (ret < 0)
+		return ret;
 
-	return size;
+	/* The authorizationSize follows the handles */
+	c->handles = (u32 *)tpmb_put(b, (nr + 1) * sizeof(u32));
+	if (c->handles == NULL)
+		return -ENOMEM;
+
+	c->auth_size = c->handles + nr;
+
+	*c->auth_size = cpu_to_be32(auth_size);
+	for (i = 0; i < nr; i++)
+		c->handles[i] = cpu_to_be32(handles[i]);
+
+	for (i = 0; i < nr; i++) {
+		c->auth = tpm2_null_auth(b);
+		if (c->auth == NULL)
+			return -ENOMEM;
+	}
+
+	return 0;
 }
 
 int tpm2_extend_pcr(struct tpm *t, u32 pcr,
-		struct tpml_digest_values *digests)
+		struct tpm_pcr_digest *digests, u32 count)
 {
 	struct tpmbuff *b = t->buff;
 	struct tpm2_cmd cmd;
+	struct tpmt_ha *h;
+	u32 params = sizeof(u32);
 	u16 size;
+	u32 i;
 	int ret = 0;
 
 	if (b == NULL) {
@@ -107,51 +111,282 @@ int tpm2_extend_pcr(struct tpm *t, u32 pcr,
 		goto out;
 	}
 
-	ret = tpm2_alloc_cmd(b, &cmd, TPM_ST_SESSIONS, TPM_CC_PCR_EXTEND);
+	for (i = 0; i < count; i++)
+		params += sizeof(u16) + tpm_digest_size(digests[i].alg);
+
+	ret = tpm2_alloc_auth_cmd(b, &cmd, TPM_CC_PCR_EXTEND, &pcr, 1, params);
 	if (ret < 0)
-		goto out;
+		goto free;
 
-	cmd.handles = (u32 *)tpmb_put(b, sizeof(u32));
-	if (cmd.handles == NULL) {
+	/* The TPML_DIGEST_VALUES goes straight into the command */
+	cmd.params = (u8 *)tpmb_put(b, sizeof(u32));
+	if (cmd.params == NULL) {
 		ret = -ENOMEM;
 		goto free;
 	}
 
-	cmd.handles[0] = cpu_to_be32(pcr);
+	*(u32 *)cmd.params = cpu_to_be32(count);
 
-	cmd.auth_size = (u32 *)tpmb_put(b, sizeof(u32));
-	if (cmd.auth_size == NULL) {
-		ret = -ENOMEM;
-		goto free;
+	for (i = 0; i < count; i++) {
+		size = tpm_digest_size(digests[i].alg);
+		h = (struct tpmt_ha *)tpmb_put(b, sizeof(u16) + size);
+		if (size == 0 || h == NULL) {
+			ret = -EINVAL;
+			goto free;
+		}
+
+		h->alg = cpu_to_be16(digests[i].alg);
+		memcpy(h->digest, digests[i].digest, size);
 	}
 
-	cmd.auth = tpm2_null_auth(b);
-	if (cmd.auth == NULL) {
-		ret = -ENOMEM;
-		goto free;
+	/* There is nothing to parse, so leave the response to tpm_complete() */
+	ret = tpm_submit(t);
+	if (ret == 0)
+		goto out;
+
+free:
+	tpmb_free(b);
+out:
+	return ret;
+}
+
+#ifdef ENABLE_TPM_HASH
+/*
+ * Finish the command with data as its only parameter, a TPM2B, and send it.
+ * The command must have been allocated with sizeof(u16) + size of params.
+ * A streamed command takes the data a buffer at a time, so it may be larger
+ * than the buffer.
+ */
+static int tpm2_transmit_buffer(struct tpm *t, const u8 *data, u16 size)
+{
+	struct tpmbuff *b = t->buff;
+	u16 *p;
+	u8 *d;
+	u16 n;
+
+	p = (u16 *)tpmb_put(b, sizeof(u16));
+	if (p == NULL)
+		return -ENOMEM;
+
+	*p = cpu_to_be16(size);
+
+	while (size > 0) {
+		n = b->stream && size > b->truesize ? b->truesize : size;
+
+		d = tpmb_put(b, n);
+		if (d == NULL)
+			return -ENOMEM;
+
+		memcpy(d, data, n);
+		data += n;
+		size -= n;
+	}
+
+	return tpm_transmit(t);
+}
+
+/* Send a command without sessions, whose only parameter is the u32 param */
+static int tpm2_transmit_u32(struct tpm *t, u32 code, u32 param)
+{
+	struct tpmbuff *b = t->buff;
+	struct tpm2_cmd cmd;
+	u32 *p;
+	int ret;
+
+	ret = tpm2_alloc_cmd(b, &cmd, TPM_ST_NO_SESSIONS, code, sizeof(u32));
+	if (ret < 0)
+		return ret;
+
+	p = (u32 *)tpmb_put(b, sizeof(u32));
+	if (p == NULL)
+		return -ENOMEM;
+
+	*p = cpu_to_be32(param);
+
+	return tpm_transmit(t);
+}
+
+/*
+ * Copy the digests of a TPM2_PCR_Event or TPM2_EventSequenceComplete response
+ * into those of the count digests with a matching alg.
+ */
+static int tpm2_get_digests(struct tpmbuff *b,
+		struct tpm_pcr_digest *digests, u32 count)
+{
+	/* The TPML_DIGEST_VALUES follows the parameterSize */
+	struct tpml_digest_values *d = (struct tpml_digest_values *)
+		(b->head + sizeof(struct tpm_header) + sizeof(u32));
+	struct tpmt_ha *h = d->digests;
+	u32 i, j;
+	u16 alg, size;
+
+	if ((u8 *)h > b->tail)
+		return -EINVAL;
+
+	for (i = be32_to_cpu(d->count); i > 0; i--) {
+		if (h->digest > b->tail)
+			return -EINVAL;
+
+		alg = be16_to_cpu(h->alg);
+		size = tpm_digest_size(alg);
+		if (size == 0 || h->digest + size > b->tail)
+			return -EINVAL;
+
+		for (j = 0; j < count; j++)
+			if (digests[j].alg == alg)
+				memcpy(digests[j].digest, h->digest, size);
+
+		h = (struct tpmt_ha *)(h->digest + size);
 	}
 
-	*cmd.auth_size = cpu_to_be32(tpm2_null_auth_size());
+	return 0;
+}
 
-	size = convert_digest_list(digests);
-	if (size == 0) {
+int tpm2_pcr_event(struct tpm *t, u32 pcr, const u8 *data, u32 size,
+		struct tpm_pcr_digest *digests, u32 count)
+{
+	struct tpmbuff *b = t->buff;
+	struct tpm2_cmd cmd;
+	u32 handles[2] = { pcr, 0 };
+	u32 chunk;
+	int ret;
+
+	/* A single TPM2_PCR_Event if the data fits, otherwise a sequence */
+	if (size <= tpm_event_max(t)) {
+		ret = tpm2_alloc_auth_cmd(b, &cmd, TPM_CC_PCR_EVENT, &pcr, 1,
+				sizeof(u16) + size);
+		if (ret == 0)
+			ret = tpm2_transmit_buffer(t, data, size);
+		goto digests;
+	}
+
+	/*
+	 * An empty auth, then TPM_ALG_NULL for an event sequence, which is
+	 * the same four bytes as a big endian TPM_ALG_NULL.
+	 */
+	ret = tpm2_transmit_u32(t, TPM_CC_HASH_SEQUENCE_START, TPM_ALG_NULL);
+	if (ret < 0)
+		goto abandon;
+
+	/* A successful response always has the sequenceHandle */
+	handles[1] = be32_to_cpu(*(u32 *)(b->head + sizeof(struct tpm_header)));
+
+	/*
+	 * Each update takes as much as a TPM2_PCR_Event could, as it also has
+	 * one handle, up to the least MAX_DIGEST_BUFFER a TPM may have.
+	 */
+	while (size > 0) {
+		chunk = tpm_event_max(t);
+		if (chunk > TPM2_MAX_DIGEST_BUFFER)
+			chunk = TPM2_MAX_DIGEST_BUFFER;
+		if (chunk > size)
+			chunk = size;
+
+		ret = tpm2_alloc_auth_cmd(b, &cmd, TPM_CC_SEQUENCE_UPDATE,
+				&handles[1], 1, sizeof(u16) + chunk);
+		if (ret < 0)
+			goto abandon;
+
+		ret = tpm2_transmit_buffer(t, data, chunk);
+		if (ret < 0)
+			goto abandon;
+
+		data += chunk;
+		size -= chunk;
+	}
+
+	/* Completing the sequence also flushes it */
+	ret = tpm2_alloc_auth_cmd(b, &cmd, TPM_CC_EVENT_SEQUENCE_COMPLETE,
+			handles, 2, sizeof(u16));
+	if (ret == 0)
+		ret = tpm2_transmit_buffer(t, NULL, 0);
+	if (ret < 0)
+		goto flush;
+
+digests:
+	/* The PCR is extended by now, only the digests can be lost */
+	if (ret == 0 && tpm2_get_digests(b, digests, count) < 0)
+		ret = -EIO;
+	goto free;
+
+abandon:
+	/* Only completing the sequence extends the PCR */
+	if (ret == -EIO)
+		ret = -EAGAIN;
+flush:
+	/* Don't leave the sequence object taking up a slot in the TPM */
+	if (handles[1] != 0)
+		tpm2_transmit_u32(t, TPM_CC_FLUSH_CONTEXT, handles[1]);
+free:
+	tpmb_free(b);
+
+	return ret;
+}
+#endif /* ENABLE_TPM_HASH */
+
+int tpm2_get_pcr_banks(struct tpm *t, u32 *banks)
+{
+	struct tpmbuff *b = t->buff;
+	struct tpm2_cmd cmd;
+	struct tpm2_cap_pcrs *cap;
+	struct tpms_pcr_selection *sel;
+	u8 *end;
+	u32 *params;
+	u32 i, j;
+	u16 alg;
+	int ret = 0;
+
+	if (b == NULL) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = tpm2_alloc_cmd(b, &cmd, TPM_ST_NO_SESSIONS,
+			TPM_CC_GET_CAPABILITY, 3 * sizeof(u32));
+	if (ret < 0)
+		goto out;
+
+	/* capability, property (the first bank) and propertyCount */
+	params = (u32 *)tpmb_put(b, 3 * sizeof(u32));
+	if (params == NULL) {
 		ret = -ENOMEM;
 		goto free;
 	}
 
-	cmd.params = (u8 *)tpmb_put(b, size);
-	if (cmd.params == NULL) {
-		ret = -ENOMEM;
+	params[0] = cpu_to_be32(TPM_CAP_PCRS);
+	params[1] = 0;
+	params[2] = cpu_to_be32(32);
+
+	ret = tpm_transmit(t);
+	if (ret < 0)
+		goto free;
+
+	cap = (struct tpm2_cap_pcrs *)(b->head + sizeof(struct tpm_header));
+	end = b->tail;
+	if ((u8 *)cap->pcrs > end ||
+	    be32_to_cpu(cap->capability) != TPM_CAP_PCRS) {
+		ret = -EINVAL;
 		goto free;
 	}
 
-	memcpy(cmd.params, digests, size);
+	/* A bank is active if any PCR is selected in it */
+	*banks = 0;
+	sel = cap->pcrs;
+	for (i = be32_to_cpu(cap->count); i > 0; i--) {
+		if (sel->pcr_select > end ||
+		    sel->pcr_select + sel->size_of_select > end) {
+			ret = -EINVAL;
+			goto free;
+		}
 
-	cmd.header->size = cpu_to_be32(tpmb_size(b));
+		alg = be16_to_cpu(sel->hash);
+		for (j = 0; j < sel->size_of_select; j++)
+			if (sel->pcr_select[j] != 0 && alg < 32)
+				*banks |= TPM_BANK(alg);
 
-	size = t->ops.send(b);
-	if (tpmb_size(b) != size)
-		ret = -EAGAIN;
+		sel = (struct tpms_pcr_selection *)
+			(sel->pcr_select + sel->size_of_select);
+	}
 
 free:
 	tpmb_free(b);
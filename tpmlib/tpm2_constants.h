@@ -58,12 +58,24 @@
 #define TPM_ALG_LAST                 _AT(u16, 0x0044)
 
 /* Table 12  Definition of (UINT32) TPM_CC Constants (Numeric Order) <IN/OUT, S> */
+#define TPM_CC_PCR_EVENT             _AT(u32, 0x0000013C)
+#define TPM_CC_SEQUENCE_UPDATE       _AT(u32, 0x0000015C)
+#define TPM_CC_FLUSH_CONTEXT         _AT(u32, 0x00000165)
+#define TPM_CC_GET_CAPABILITY        _AT(u32, 0x0000017A)
 #define TPM_CC_PCR_EXTEND            _AT(u32, 0x00000182)
+#define TPM_CC_EVENT_SEQUENCE_COMPLETE _AT(u32, 0x00000185)
+#define TPM_CC_HASH_SEQUENCE_START   _AT(u32, 0x00000186)
+
+/* Table 16  Definition of (UINT32) TPM_RC Constants (Actions) <OUT> */
+#define TPM_RC_SUCCESS               _AT(u32, 0x00000000)
 
 /* Table 19  Definition of (UINT16) TPM_ST Constants <IN/OUT, S> */
 #define TPM_ST_NO_SESSIONS           _AT(u16, 0x8001)
 #define TPM_ST_SESSIONS              _AT(u16, 0x8002)
 
+/* Table 23  Definition of (UINT32) TPM_CAP Constants */
+#define TPM_CAP_PCRS                 _AT(u32, 0x00000005)
+
 /* Table 28  Definition of (TPM_HANDLE) TPM_RH Constants <S> */
 #define TPM_RS_PW                    _AT(u32, 0x40000009)
 
@@ -10,11 +10,13 @@
 
 #include <linux/types.h>
 #include <linux/string.h>
+#include <linux/errno.h>
 
 #elif defined LINUX_USERSPACE
 
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 
 #endif
@@ -24,12 +26,63 @@
 #include "tpm.h"
 #include "tpmbuff.h"
 #include "tpm_common.h"
+#include "tis.h"
 
-#define STATIC_TIS_BUFFER_SIZE		1024
+/*
+ * The TIS buffer lives in the SLB.  Commands are streamed through it into
+ * the FIFO, so it need only hold the largest single tpmb_put(), or the
+ * largest response SKL parses: the PCR banks.  The digests from a
+ * TPM2_PCR_Event of more than two banks, up to 229 bytes, go to the spill
+ * area given by tpm_spill().
+ */
+#define STATIC_TIS_BUFFER_SIZE		128
 
 #define TPM_CRB_DATA_BUFFER_OFFSET	0x80
 #define TPM_CRB_DATA_BUFFER_SIZE	3966
 
+/* Swap the buffer's storage with the spill area */
+static void tpmb_swap(struct tpmbuff *b)
+{
+	u8 *head = b->spill;
+	size_t size = b->spill_size;
+
+	b->spill = b->head;
+	b->spill_size = b->truesize;
+	b->spilled = !b->spilled;
+
+	b->head = head;
+	b->truesize = size;
+	b->end = head + (size - 1);
+}
+
+/* Move to the spill area, if there is one and at least need bytes fit */
+static int tpmb_spill_over(struct tpmbuff *b, size_t need)
+{
+	u8 *head = b->spill;
+
+	if (b->spilled || head == NULL || need > b->spill_size)
+		return 0;
+
+	memcpy(head, b->head, b->len);
+
+	b->data = head + (b->data - b->head);
+	b->tail = head + b->len;
+	tpmb_swap(b);
+
+	return 1;
+}
+
+int tpmb_spill(struct tpmbuff *b, u8 *area, size_t size)
+{
+	if (!b->fifo || b->spilled)
+		return -EINVAL;
+
+	b->spill = area;
+	b->spill_size = size;
+
+	return 0;
+}
+
 u8 *tpmb_reserve(struct tpmbuff *b)
 {
 	if (b->locked)
@@ -37,6 +90,8 @@ u8 *tpmb_reserve(struct tpmbuff *b)
 
 	b->len = sizeof(struct tpm_header);
 	b->locked = 1;
+	b->stream = b->fifo;
+	b->sent = 0;
 	b->data = b->head + b->len;
 	b->tail = b->data;
 
@@ -49,16 +104,36 @@ void tpmb_free(struct tpmbuff *b)
 
 	b->len = 0;
 	b->locked = 0;
+	b->stream = 0;
+	b->sent = 0;
 	b->data = NULL;
 	b->tail = NULL;
+
+	if (b->spilled)
+		tpmb_swap(b);
 }
 
+/*
+ * While a command is streamed, what the buffer holds is sent on to the TPM
+ * before making room for more.  So the header, with the command's final
+ * size, must be filled in before the first put, and earlier puts must not
+ * be written to after a later one.
+ */
 u8 *tpmb_put(struct tpmbuff *b, size_t size)
 {
-	u8 *tail = b->tail;
+	u8 *tail;
+
+#ifdef ENABLE_TPM_TIS
+	if (b->stream && !tis_flush(b, 0))
+		return NULL;
+#endif
+
+	/* Only a response may spill, see tpmb_spill() */
+	if ((b->len + size) > b->truesize &&
+	    (b->stream || !tpmb_spill_over(b, b->len + size)))
+		return NULL;
 
-	if ((b->len + size) > b->truesize)
-		return NULL; /* TODO: add overflow buffer support */
+	tail = b->tail;
 
 	b->tail += size;
 	b->len += size;
@@ -71,20 +146,21 @@ size_t tpmb_trim(struct tpmbuff *b, size_t size)
 	if (b->len < size)
 		size = b->len;
 
-	/* TODO: add overflow buffer support */
-
 	b->tail -= size;
 	b->len -= size;
 
 	return size;
 }
 
+/* The size of the command or response so far, including anything streamed */
 size_t tpmb_size(struct tpmbuff *b)
 {
-	return b->len;
+	return b->sent + b->len;
 }
 
+#ifdef ENABLE_TPM_TIS
 static u8 tis_buff[STATIC_TIS_BUFFER_SIZE];
+#endif
 static struct tpmbuff tpm_buff;
 
 struct tpmbuff *alloc_tpmbuff(enum tpm_hw_intf intf, u8 locality)
@@ -92,25 +168,31 @@ struct tpmbuff *alloc_tpmbuff(enum tpm_hw_intf intf, u8 locality)
 	struct tpmbuff *b = &tpm_buff;
 
 	switch (intf) {
+#ifdef ENABLE_TPM_TIS
 	case TPM_TIS:
-		if (b->head)
-			goto reset;
-
 		b->head = (u8 *)&tis_buff;
 		b->truesize = STATIC_TIS_BUFFER_SIZE;
+		b->fifo = 1;
 		break;
+#endif
+#ifdef ENABLE_TPM_CRB
 	case TPM_CRB:
 		b->head = (u8 *)(uintptr_t)(TPM_MMIO_BASE + (locality << 12)
 			       + TPM_CRB_DATA_BUFFER_OFFSET);
 		b->truesize = TPM_CRB_DATA_BUFFER_SIZE;
+		b->fifo = 0;
 		break;
+#endif
 	default:
 		return NULL;
 	}
 
-reset:
 	b->len = 0;
 	b->locked = 0;
+	b->stream = 0;
+	b->sent = 0;
+	b->spilled = 0;
+	b->spill = NULL;
 	b->data = NULL;
 	b->tail = NULL;
 	b->end = b->head + (b->truesize - 1);
@@ -17,7 +17,20 @@
 #define __maybe_unused  __attribute__ ((unused))
 #endif
 
+#ifdef LINUX_USERSPACE
+/*
+ * Hosted, the registers and the time base are those of a model of the TPM
+ * (see test-tpm.c).  It provides the register accessors, tpm_tsc_per_us()
+ * and these, and the memory a CRB data buffer is in.
+ */
+u64 rdtsc(void);
+void cpu_relax(void);
+
+extern uintptr_t tpm_mmio_base;
+#define TPM_MMIO_BASE		tpm_mmio_base
+#else
 #define TPM_MMIO_BASE		0xFED40000
+#endif
 #define TPM_MAX_LOCALITY	4
 
 #define SHA1_SIZE	20
@@ -81,54 +94,86 @@ struct tpm_intf_capability {
 	};
 } __packed;
 
-void tpm_udelay(int loops);
+/*
+ * Absolute deadlines, us microseconds from now, for polling loops.  The
+ * delays below are built on these.
+ */
+u64 tpm_deadline(u32 us);
+u8 tpm_expired(u64 deadline);
+u32 tpm_tsc_per_us(void);
+
+/* Poll a register until (value & mask) == val, returning 0 on timeout */
+u8 tpm_wait8(u32 field, u8 mask, u8 val, u32 us);
+u8 tpm_wait32(u32 field, u32 mask, u32 val, u32 us);
+
+void tpm_udelay(int us);
 void tpm_mdelay(int ms);
 
 /*
  * Timeouts defined in Table 16 from the TPM2 PTP and
- * Table 15 from the PC Client TIS
+ * Table 15 from the PC Client TIS, in microseconds for tpm_deadline().  These
+ * are only the defaults for tpm_timeouts.
  */
+#define TIMEOUT_A		750000
+#define TIMEOUT_B		2000000
+/* Timeouts C & D are different between 1.2 & 2.0 */
+#define TPM1_TIMEOUT_C		750000
+#define TPM1_TIMEOUT_D		750000
+#define TPM2_TIMEOUT_C		200000
+#define TPM2_TIMEOUT_D		30000
 
-/* TPM Timeout A: 750ms */
-static inline void timeout_a(void)
-{
-	tpm_mdelay(750);
-}
+/*
+ * Durations derived from Table 15 of the PTP but is purely an artifact of this
+ * implementation
+ */
+#define DURATION_A		20000	/* TPM Duration A: 20ms */
+#define DURATION_B		750000	/* TPM Duration B: 750ms */
+#define DURATION_C		1000000	/* TPM Duration C: 1000ms */
 
-/* TPM Timeout B: 2000ms */
-static inline void timeout_b(void)
-{
-	tpm_mdelay(2000);
-}
+/*
+ * The timeouts and duration in use, in microseconds.  enable_tpm() starts
+ * from the defaults for the family, then takes what the TPM reports and any
+ * quirks for the part.
+ */
+struct tpm_timeouts {
+	u32 a, b, c, d;
+	u32 duration_a;		/* The short commands SKL sends */
+};
 
-/* Timeouts C & D are different between 1.2 & 2.0 */
-/* TPM1.2 Timeout C: 750ms */
-static inline void tpm1_timeout_c(void)
-{
-	tpm_mdelay(750);
-}
-
-/* TPM1.2 Timeout D: 750ms */
-static inline void tpm1_timeout_d(void)
-{
-	tpm_mdelay(750);
-}
-
-/* TPM2 Timeout C: 200ms */
-static inline void tpm2_timeout_c(void)
-{
-	tpm_mdelay(200);
-}
-
-/* TPM2 Timeout D: 30ms */
-static inline void tpm2_timeout_d(void)
-{
-	tpm_mdelay(30);
-}
+extern struct tpm_timeouts tpm_timeouts;
+
+/*
+ * Most command sequences this code is interested with operate with a 20/750
+ * duration/timeout schedule, so allow that long for a command to complete.
+ */
+#define TPM_CMD_TIMEOUT		(tpm_timeouts.duration_a + tpm_timeouts.a)
+
+struct tpm;
+
+/*
+ * Send the command in t->buff and receive the response in its place, with
+ * the header converted to CPU endianness.  Returns 0 only if the TPM
+ * executed the command successfully.  -EAGAIN means it did not execute it:
+ * it could not be sent, or the TPM answered with an error code.  -EIO means
+ * the response was lost after the command was sent, so it may have run.
+ */
+int tpm_transmit(struct tpm *t);
+
+/*
+ * The two halves of tpm_transmit().  After tpm_submit(), t->buff belongs to
+ * the command in flight until tpm_complete() (see tpm.h).
+ */
+int tpm_submit(struct tpm *t);
 
 u8 tpm_read8(u32 field);
 void tpm_write8(unsigned char val, u32 field);
 u32 tpm_read32(u32 field);
 void tpm_write32(unsigned int val, u32 field);
 
+/* Unfenced, for bursts of FIFO accesses between fenced status reads */
+u8 tpm_read8_relaxed(u32 field);
+void tpm_write8_relaxed(unsigned char val, u32 field);
+u32 tpm_read32_relaxed(u32 field);
+void tpm_write32_relaxed(unsigned int val, u32 field);
+
 #endif
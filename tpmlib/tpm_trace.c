@@ -0,0 +1,124 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef LINUX_KERNEL
+
+#include <linux/types.h>
+#include <linux/string.h>
+
+#elif defined LINUX_USERSPACE
+
+#include <string.h>
+
+#endif
+
+#include <string.h>
+
+#include "tpm.h"
+#include "tpm_common.h"
+#include "tpm_trace.h"
+
+/*
+ * The ring is outside the SLB, where a device can write to it, so nothing is
+ * ever read back from it.  Its nr and count, and the record being written,
+ * are kept here and only copied out.
+ */
+static struct tpm_trace_ring *ring;
+static u32 nr, count;
+
+/* The record being written, and when its current state started */
+static struct tpm_trace_rec rec, *cur;
+static u64 last;
+
+void tpm_trace_init(void *area, u32 size)
+{
+	if (size < sizeof(*ring) + sizeof(ring->recs[0]))
+		return;
+
+	ring = area;
+	memset(ring, 0, sizeof(*ring));
+
+	nr = (size - sizeof(*ring)) / sizeof(ring->recs[0]);
+	count = 0;
+
+	ring->magic = TPM_TRACE_MAGIC;
+	ring->tsc_per_us = tpm_tsc_per_us();
+	ring->nr = nr;
+}
+
+static void tpm_trace_write(void)
+{
+	memcpy(&ring->recs[count % nr], &rec, sizeof(rec));
+}
+
+void tpm_trace_tpm(struct tpm *t)
+{
+	if (!ring)
+		return;
+
+	ring->vendor = t->vendor;
+	ring->family = t->family;
+	ring->intf = t->intf;
+}
+
+void tpm_trace_start(u32 code, u32 sent)
+{
+	if (!ring)
+		return;
+
+	/* A record left open never got its end, so is just reused */
+	cur = &rec;
+	memset(cur, 0, sizeof(*cur));
+
+	cur->code = code;
+	cur->sent = sent;
+	tpm_trace_write();
+	last = rdtsc();
+}
+
+/* Charge the time since the last mark to state */
+void tpm_trace_mark(u32 state)
+{
+	u64 now, ticks;
+
+	if (!cur)
+		return;
+
+	now = rdtsc();
+	ticks = cur->ticks[state] + (now - last);
+	cur->ticks[state] = ticks > 0xFFFFFFFF ? 0xFFFFFFFF : ticks;
+	last = now;
+}
+
+void tpm_trace_poll(void)
+{
+	if (cur)
+		cur->polls++;
+}
+
+void tpm_trace_end(u32 received, u32 rc)
+{
+	if (!cur)
+		return;
+
+	cur->received = received;
+	cur->rc = rc;
+	cur = NULL;
+
+	tpm_trace_write();
+	ring->nr = nr;
+	ring->count = ++count;
+}
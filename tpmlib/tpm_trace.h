@@ -0,0 +1,86 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _TPM_TRACE_H
+#define _TPM_TRACE_H
+
+/*
+ * A trace of the TPM commands and locality changes, with where the time
+ * went, written to a ring in memory the OS can read back.  Only built with
+ * ENABLE_TPM_TRACE.
+ */
+
+/* Where a record's time went, in ticks[] */
+#define TPM_TRACE_READY		0	/* Waiting for locality or commandReady */
+#define TPM_TRACE_SEND		1	/* Writing the command */
+#define TPM_TRACE_OVERLAP	2	/* Running, while the caller did other work */
+#define TPM_TRACE_EXEC		3	/* Running, while waited for */
+#define TPM_TRACE_RECV		4	/* Reading the response */
+#define TPM_TRACE_STATES	5
+
+/* code of a locality request, with the locality in the low byte */
+#define TPM_TRACE_LOCALITY	0xFFFFFF00
+#define TPM_TRACE_RELINQUISH	0xFFFFFFFF
+
+/* rc of a command which got no response */
+#define TPM_TRACE_FAILED	0xFFFFFFFF
+
+#define TPM_TRACE_MAGIC		0x45435254	/* "TRCE" */
+
+struct tpm_trace_rec {
+	u32 code;		/* TPM_ORD_* or TPM_CC_*, or TPM_TRACE_* */
+	u32 sent;		/* Bytes */
+	u32 received;
+	u32 polls;		/* Status polls while waiting */
+	u32 ticks[TPM_TRACE_STATES];	/* TSC ticks, saturating */
+	u32 rc;			/* Response code, or locality granted */
+} __packed;
+
+struct tpm_trace_ring {
+	u32 magic;
+	u32 tsc_per_us;		/* For converting ticks */
+	u32 vendor;		/* As in struct tpm */
+	u8 family;
+	u8 intf;
+	u16 reserved;
+	u32 nr;			/* Records the ring holds */
+	u32 count;		/* Records written, the last nr of them kept */
+	struct tpm_trace_rec recs[];
+} __packed;
+
+#ifdef ENABLE_TPM_TRACE
+
+/* Start tracing into area, which must stay mapped, of size bytes */
+void tpm_trace_init(void *area, u32 size);
+
+/* Hooks for the rest of tpmlib */
+void tpm_trace_tpm(struct tpm *t);
+void tpm_trace_start(u32 code, u32 sent);
+void tpm_trace_mark(u32 state);
+void tpm_trace_poll(void);
+void tpm_trace_end(u32 received, u32 rc);
+
+#else
+
+static inline void tpm_trace_tpm(struct tpm *t) {}
+static inline void tpm_trace_start(u32 code, u32 sent) {}
+static inline void tpm_trace_mark(u32 state) {}
+static inline void tpm_trace_poll(void) {}
+static inline void tpm_trace_end(u32 received, u32 rc) {}
+
+#endif /* ENABLE_TPM_TRACE */
+
+#endif
@@ -15,6 +15,13 @@ struct tpmbuff {
 	size_t len;
 
 	u8 locked;
+	u8 fifo;		/* Commands can be streamed, see tpmb_put() */
+	u8 stream;		/* Streaming the command being built */
+	size_t sent;		/* Bytes of it already streamed */
+
+	u8 spilled;		/* Using the spill area, see tpmb_spill() */
+	u8 *spill;
+	size_t spill_size;
 
 	u8 *head;
 	u8 *data;
@@ -27,6 +34,19 @@ void tpmb_free(struct tpmbuff *b);
 u8 *tpmb_put(struct tpmbuff *b, size_t size);
 size_t tpmb_trim(struct tpmbuff *b, size_t size);
 size_t tpmb_size(struct tpmbuff *b);
+
+/*
+ * Let a TIS buffer grow into area, of size bytes, when a put doesn't fit.
+ * What it holds is copied there once, and it goes back to its own storage
+ * when freed, so small responses never touch the area.  The area is
+ * normally outside the SLB, so it is open to DMA, and a caller must treat
+ * what it parses from there accordingly.  For the same reason a command,
+ * which is streamed, never spills: what the TPM executes must not pass
+ * through memory a device could change.  The area stays in place until the
+ * buffer is next allocated.  A CRB command and its response are in the CRB
+ * data buffer itself, so they have nowhere to spill to.
+ */
+int tpmb_spill(struct tpmbuff *b, u8 *area, size_t size);
 struct tpmbuff *alloc_tpmbuff(enum tpm_hw_intf i, u8 locality);
 void free_tpmbuff(struct tpmbuff *b, enum tpm_hw_intf i);
 
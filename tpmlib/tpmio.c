@@ -14,27 +14,127 @@
 
 #include "tpm.h"
 #include "tpm_common.h"
+#include "tpm_trace.h"
 
-static noinline void tpm_io_delay(void)
+/*
+ * The time base is the TSC, calibrated against PIT channel 2 on first use.
+ * Port 0x80 writes, used before, take anything from well under to several
+ * microseconds depending on the chipset.
+ */
+#define PIT_CH2			0x42
+#define PIT_MODE		0x43
+#define PIT_GATE		0x61
+#define PIT_GATE_OUT2		0x20
+#define PIT_HZ			1193182
+
+#define CALIBRATE_MS		10
+#define CALIBRATE_TICKS		(PIT_HZ * CALIBRATE_MS / 1000)
+
+/*
+ * Should the PIT not count, assume a TSC faster than any SKINIT capable part
+ * has, so delays only err on the long side.
+ */
+#define FALLBACK_TSC_PER_US	5000
+
+#ifndef LINUX_USERSPACE
+static u32 tsc_per_us;
+
+static void calibrate_tsc(void)
 {
-	/* This is the default delay type in native_io_delay */
-	asm volatile ("outb %al, $0x80");
+	u8 gate = inb(PIT_GATE);
+	u32 loops = 0;
+	u64 start;
+	u32 ticks;
+
+	/* Gate channel 2 on with the speaker off, one shot (mode 0) */
+	outb((gate & ~0x02) | 0x01, PIT_GATE);
+	outb(0xb0, PIT_MODE);
+	outb(CALIBRATE_TICKS & 0xff, PIT_CH2);
+	outb(CALIBRATE_TICKS >> 8, PIT_CH2);
+
+	start = rdtsc();
+	while (!(inb(PIT_GATE) & PIT_GATE_OUT2) && ++loops < 1000000)
+		;
+	/* A 10ms delta fits in 32 bits, and avoids a 64-bit division */
+	ticks = rdtsc() - start;
+
+	outb(gate, PIT_GATE);
+
+	tsc_per_us = ticks / (CALIBRATE_MS * 1000);
+	if (loops == 1000000 || tsc_per_us == 0)
+		tsc_per_us = FALLBACK_TSC_PER_US;
 }
 
-void tpm_udelay(int loops)
+u32 tpm_tsc_per_us(void)
 {
-	while (loops--)
-		tpm_io_delay();	/* Approximately 1 us */
+	if (tsc_per_us == 0)
+		calibrate_tsc();
+
+	return tsc_per_us;
 }
+#endif /* LINUX_USERSPACE */
 
-void tpm_mdelay(int ms)
+u64 tpm_deadline(u32 us)
+{
+	return rdtsc() + (u64)us * tpm_tsc_per_us();
+}
+
+/* Every polling loop checks its deadline once a poll, so count them here */
+u8 tpm_expired(u64 deadline)
+{
+	tpm_trace_poll();
+
+	return (s64)(rdtsc() - deadline) >= 0;
+}
+
+/*
+ * Poll field until (value & mask) == val, for at most us microseconds.
+ * Returns 1 as soon as it matches, 0 on timeout.
+ */
+u8 tpm_wait8(u32 field, u8 mask, u8 val, u32 us)
+{
+	u64 deadline = tpm_deadline(us);
+
+	for (;;) {
+		if ((tpm_read8(field) & mask) == val)
+			return 1;
+
+		if (tpm_expired(deadline))
+			return 0;
+
+		cpu_relax();
+	}
+}
+
+u8 tpm_wait32(u32 field, u32 mask, u32 val, u32 us)
 {
-	int i;
+	u64 deadline = tpm_deadline(us);
 
-	for (i = 0; i < ms; i++)
-		tpm_udelay(1000);
+	for (;;) {
+		if ((tpm_read32(field) & mask) == val)
+			return 1;
+
+		if (tpm_expired(deadline))
+			return 0;
+
+		cpu_relax();
+	}
 }
 
+void tpm_udelay(int us)
+{
+	u64 deadline = tpm_deadline(us);
+
+	while (!tpm_expired(deadline))
+		cpu_relax();
+}
+
+void tpm_mdelay(int ms)
+{
+	tpm_udelay(ms * 1000);
+}
+
+#ifndef LINUX_USERSPACE
 u8 tpm_read8(u32 field)
 {
 	void *mmio_addr = (void *)(uintptr_t)(TPM_MMIO_BASE | field);
@@ -62,3 +162,32 @@ void tpm_write32(unsigned int val, u32 field)
 
 	iowrite32(val, mmio_addr);
 }
+
+u8 tpm_read8_relaxed(u32 field)
+{
+	void *mmio_addr = (void *)(uintptr_t)(TPM_MMIO_BASE | field);
+
+	return ioread8_relaxed(mmio_addr);
+}
+
+void tpm_write8_relaxed(unsigned char val, u32 field)
+{
+	void *mmio_addr = (void *)(uintptr_t)(TPM_MMIO_BASE | field);
+
+	iowrite8_relaxed(val, mmio_addr);
+}
+
+u32 tpm_read32_relaxed(u32 field)
+{
+	void *mmio_addr = (void *)(uintptr_t)(TPM_MMIO_BASE | field);
+
+	return ioread32_relaxed(mmio_addr);
+}
+
+void tpm_write32_relaxed(unsigned int val, u32 field)
+{
+	void *mmio_addr = (void *)(uintptr_t)(TPM_MMIO_BASE | field);
+
+	iowrite32_relaxed(val, mmio_addr);
+}
+#endif /* LINUX_USERSPACE */